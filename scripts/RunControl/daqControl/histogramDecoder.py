@@ -0,0 +1,93 @@
+#
+#  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+#
+"""
+Decoder for histograms published in the compact binary format (HistogramManager
+with "histogramFormat": "binary"). Returns the same dictionary as the JSON format.
+HistogramCache rebuilds full histograms from the deltas sent with "histogramKeyframes".
+Messages compressed with "histogramCompression" ('-hz_', '-hbz_') are decompressed first.
+"""
+import json
+import struct
+import zlib
+
+VERSION=1
+FLOAT32=0
+VARINT=1
+
+def decodeHistogram(data):
+    """Decodes the body of a binary histogram message (after '<source>-hb_<name>: ')"""
+    version,encoding,headSize=struct.unpack_from("<BBH",data,0)
+    if version!=VERSION:
+        raise ValueError("Unsupported binary histogram version %d" % version)
+    pos=4
+    hist=json.loads(data[pos:pos+headSize].decode())
+    pos+=headSize
+    nvalues,=struct.unpack_from("<I",data,pos)
+    pos+=4
+    if encoding==FLOAT32:
+        values=list(struct.unpack_from("<%df" % nvalues,data,pos))
+    elif encoding==VARINT:
+        values=[]
+        value=0
+        shift=0
+        for byte in data[pos:]:
+            value|=(byte&0x7f)<<shift
+            if byte&0x80:
+                shift+=7
+            else:
+                values.append(value)
+                value=0
+                shift=0
+        if len(values)!=nvalues:
+            raise ValueError("Expected %d bins, decoded %d" % (nvalues,len(values)))
+    else:
+        raise ValueError("Unknown bin encoding %d" % encoding)
+    if hist["type"].startswith("2d"):
+        hist["zvalues"]=values
+    else:
+        hist["yvalues"]=values
+    return hist
+
+def decodeMessage(data):
+    """Splits a histogram message into source, histogram name (as 'h_<name>') and JSON string,
+    whether published as JSON or in the binary format, compressed or not"""
+    head,body=data.split(b': ',1)
+    source,name=head.decode().split("-",1)
+    if name.startswith("hz_") or name.startswith("hbz_"):
+        try:
+            body=zlib.decompress(body)
+        except zlib.error as e:
+            raise ValueError("Corrupted compressed histogram: %s" % e)
+        name=name.replace("z_","_",1)
+    if name.startswith("hb_"):
+        try:
+            return source,"h_"+name[3:],json.dumps(decodeHistogram(body))
+        except struct.error as e:
+            raise ValueError("Truncated binary histogram: %s" % e)
+    return source,name,body.decode()
+
+class HistogramCache:
+    """Last full contents of each histogram, to apply deltas to"""
+    def __init__(self):
+        self.hists={}
+
+    def update(self,source,name,value):
+        """Returns the full histogram as JSON string, or None for a delta before any full publish"""
+        if not '"delta"' in value:
+            self.hists[(source,name)]=value # only decoded when a delta arrives
+            return value
+        delta=json.loads(value)
+        if not delta.get("delta"):
+            self.hists[(source,name)]=delta
+            return value
+        hist=self.hists.get((source,name))
+        if hist is None:
+            return None
+        if isinstance(hist,str):
+            hist=json.loads(hist)
+            self.hists[(source,name)]=hist
+        key="zvalues" if "zvalues" in delta else "yvalues"
+        for bin,content in zip(delta["bins"],delta[key]):
+            hist[key][bin]=content
+        return json.dumps(hist)
@@ -6,6 +6,8 @@ import threading
 import time
 import zmq
 
+import histogramDecoder
+
 metricsAddress="tcp://127.0.0.1:7000"   #for now the port is hardcoded to 7000 on localhost
 historyLength=9                         # this should be configurable
 
@@ -20,11 +22,22 @@ def metricsHandler(stopEvent,logger):
     sock = context.socket(zmq.SUB)
     sock.bind(metricsAddress)
     sock.setsockopt_string(zmq.SUBSCRIBE,"")
+    histograms=histogramDecoder.HistogramCache()
 
     while not stopEvent.isSet():
         events=sock.poll(timeout=1000)
         if not events: continue
         data=sock.recv()
+        head=data.split(b': ',1)[0]
+        if b"-hb_" in head or b"-hz_" in head or b"-hbz_" in head: # binary or compressed histogram, may contain any byte
+            try:
+                source,name,value=histogramDecoder.decodeMessage(data)
+                value=histograms.update(source,name,value)
+                if value is not None:
+                    r1.hset(source,name,str(time.time())+":"+value)
+            except ValueError:
+                logger.error("Failed to decode binary or compressed histogram: %s",data[:100])
+            continue
         mapping={}
         for line in data.decode().split('\n'):
             try:
@@ -32,6 +45,8 @@ def metricsHandler(stopEvent,logger):
                 source,rest=line.split("-",1)
                 if rest.startswith("h_"): # FIXME Maybe can think of better way of identifying histograms
                     name,value=rest.split(': ',1)
+                    value=histograms.update(source,name,value)
+                    if value is None: continue
                     val=str(time.time())+":"+value
                     r1.hset(source,name,val)
                 else:
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+#
+# Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+#
+
+# Reads histograms from an archive written by the HistogramArchiver module: gzipped JSON
+# lines, one gzip member per histogram record, with an index "offset size ts source name"
+# per record in <archive>.idx
+
+import argparse
+import gzip
+import json
+import os
+import zlib
+
+def readIndex(fileName):
+    """Index entries (offset, size, ts, source, name), or None if there is no index"""
+    if not os.path.exists(fileName+".idx"):
+        return None
+    entries=[]
+    for line in open(fileName+".idx"):
+        offset,size,ts,source,name=line.split()
+        entries.append((int(offset),int(size),float(ts),source,name))
+    return entries
+
+def readRecords(fileName,source=None,name=None,latest=True):
+    """Histogram records of the archive, optionally only from one source and/or with one name,
+    and by default only the latest record of each histogram"""
+    entries=readIndex(fileName)
+    if entries is None: # no index: decompress everything
+        records=[json.loads(line) for line in gzip.open(fileName,"rt")]
+        records=[r for r in records if (source is None or r["source"]==source) and (name is None or r["name"]==name)]
+    else:
+        entries=[e for e in entries if (source is None or e[3]==source) and (name is None or e[4]==name)]
+        if latest:
+            entries=list({(e[3],e[4]):e for e in entries}.values())
+        records=[]
+        with open(fileName,"rb") as archive:
+            for offset,size,ts,src,hname in entries:
+                archive.seek(offset)
+                records.append(json.loads(zlib.decompress(archive.read(size),16+zlib.MAX_WBITS)))
+    if latest:
+        records=list({(r["source"],r["name"]):r for r in records}.values())
+    return records
+
+def main():
+    parser=argparse.ArgumentParser(description="Reads histograms from a histogram archive")
+    parser.add_argument("archive",help="archive file")
+    parser.add_argument("-s","--source",help="only histograms of this source (monitor)")
+    parser.add_argument("-n","--name",help="only histograms with this name")
+    parser.add_argument("-a","--all",action="store_true",help="all archived versions, not only the latest")
+    parser.add_argument("-l","--list",action="store_true",help="only list source, name and time")
+    args=parser.parse_args()
+
+    records=readRecords(args.archive,args.source,args.name,not args.all)
+    if args.list:
+        for record in records:
+            print("%s %s %.0f" % (record["source"],record["name"],record["ts"]))
+    elif args.all:
+        for record in records:
+            print(json.dumps(record))
+    else:
+        hists={}
+        for record in records: # same layout as the archives of earlier versions
+            hists.setdefault(record.pop("source"),{})[record["name"]]=record
+        print(json.dumps(hists))
+
+if __name__ == "__main__":
+    main()
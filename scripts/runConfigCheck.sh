@@ -21,6 +21,7 @@ schemas/TriggerMonitor.schema     \
 schemas/TriggerRateMonitor.schema     \
 schemas/TriggerReceiver.schema     \
 schemas/HistogramArchiver.schema \
+schemas/HistogramAggregator.schema \
 --templates \
 Templates/TLB.json \
 Templates/TRB.json \
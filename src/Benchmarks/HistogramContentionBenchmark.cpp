@@ -0,0 +1,69 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+/**
+ * Measures how much publishing stalls histogram filling: one thread fills at a fixed
+ * rate (1 MHz by default) while the HistogramManager publishes 200 histograms every 5 s.
+ * Reports the distribution of the time spent in each fill and how far the filler fell
+ * behind its schedule.
+ *
+ * Usage: HistogramContentionBenchmark [seconds] [fill rate in Hz]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Utils/HistogramManager.hpp"
+
+using namespace std::chrono;
+
+int main(int argc, char** argv) {
+  double seconds = argc > 1 ? std::atof(argv[1]) : 12;
+  double rate = argc > 2 ? std::atof(argv[2]) : 1e6;
+  const unsigned nHists = 200;
+  const unsigned nBins = 1000;
+
+  HistogramManager manager("HistogramContentionBenchmark");
+  manager.configure(1, "tcp://localhost:5555"); // publishes into the void every 5 s
+  std::vector<Hist1DHandle> hists;
+  for (unsigned ii = 0; ii < nHists; ii++)
+    hists.push_back(manager.registerHistogram("hist"+std::to_string(ii), "x", 0, nBins, nBins));
+  manager.start();
+
+  // fill durations in power of two ns bins
+  std::vector<unsigned long> durations(32, 0);
+  nanoseconds maxDuration(0), maxLag(0);
+  unsigned long fills = 0;
+  nanoseconds period(static_cast<long>(1e9/rate));
+  auto start = steady_clock::now();
+  auto end = start+duration_cast<nanoseconds>(duration<double>(seconds));
+  auto due = start;
+  while (due < end) {
+    auto now = steady_clock::now();
+    while (now < due) now = steady_clock::now();
+    maxLag = std::max(maxLag, duration_cast<nanoseconds>(now-due));
+    manager.fill(hists[fills%nHists], (fills*7)%nBins);
+    auto done = steady_clock::now();
+    nanoseconds took = done-now;
+    maxDuration = std::max(maxDuration, took);
+    unsigned bin = 0;
+    while (bin < 31 && (1l<<(bin+1)) <= took.count()) bin++;
+    durations[bin]++;
+    fills++;
+    due += period;
+    if (done > due+period*1000) due = done; // fell behind by more than 1000 fills: do not try to catch up
+  }
+  double elapsed = duration<double>(steady_clock::now()-start).count();
+  manager.stop();
+
+  std::cout << "fills: " << fills << " (" << fills/elapsed/1e6 << " MHz requested " << rate/1e6 << " MHz)" << std::endl;
+  std::cout << "longest fill: " << maxDuration.count()/1e3 << " us, largest lag behind schedule: " << maxLag.count()/1e3 << " us" << std::endl;
+  std::cout << "fill duration distribution:" << std::endl;
+  for (unsigned bin = 0; bin < durations.size(); bin++)
+    if (durations[bin]) std::cout << "  >= " << (1l<<bin) << " ns: " << durations[bin] << std::endl;
+  return 0;
+}
@@ -0,0 +1,61 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+/**
+ * Compares the rate of histogram fills by name with fills through a handle,
+ * for the histogram types used by the monitoring modules.
+ *
+ * Usage: HistogramFillBenchmark [fills per test]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "Utils/HistogramManager.hpp"
+
+namespace {
+  template<typename F>
+  void run(const std::string& test, unsigned long calls, F&& fill, unsigned fillsPerCall = 1) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long ii = 0; ii < calls; ii++) fill(ii);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::left << std::setw(32) << test << std::right << std::setw(12)
+              << std::fixed << std::setprecision(1) << calls*fillsPerCall/elapsed.count()/1e6 << " Mfills/s" << std::endl;
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned long fills = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 10000000;
+
+  HistogramManager manager("HistogramFillBenchmark");
+  manager.configure(1, "tcp://localhost:5555"); // never started, nothing is published
+
+  // a realistic number of histograms, so that the lookup by name is not artificially cheap
+  std::vector<Hist1DHandle> histPulse;
+  for (int ch = 0; ch < 16; ch++)
+    histPulse.push_back(manager.registerHistogram("pulse_ch"+std::to_string(ch), "ADC counts", 0, 1000, 1000));
+  auto hist1D = manager.registerHistogram("bcid", "BCID", -0.5, 4095.5, 4096);
+  auto hist2D = manager.register2DHistogram("trigline_vs_trigitem", "line", -0.5, 7.5, 8, "item", -0.5, 5.5, 6);
+  std::vector<std::string> categories = {"Ok", "Error", "Warning", "Missing"};
+  auto histCat = manager.registerHistogram("errors", "error type", categories);
+  std::vector<int> pulse(200, 1);
+
+  run("1D by name", fills, [&](unsigned long ii) { manager.fill("bcid", ii & 0xfff); });
+  run("1D by handle", fills, [&](unsigned long ii) { manager.fill(hist1D, ii & 0xfff); });
+  run("2D by name", fills, [&](unsigned long ii) { manager.fill2D("trigline_vs_trigitem", ii & 7, ii % 6); });
+  run("2D by handle", fills, [&](unsigned long ii) { manager.fill2D(hist2D, ii & 7, ii % 6); });
+  run("category by name", fills, [&](unsigned long ii) { manager.fill("errors", categories[ii & 3]); });
+  run("category by handle", fills, [&](unsigned long ii) { manager.fill(histCat, categories[ii & 3]); });
+  int bin = manager.categoryBin(histCat, "Warning");
+  run("category by bin", fills, [&](unsigned long) { manager.fillBin(histCat, bin); });
+  // per channel pulse: name built per event, as the monitors did before handles
+  unsigned long events = fills/pulse.size();
+  run("pulse by name", events, [&](unsigned long ii) {
+      std::string name = "pulse_ch"+std::to_string(ii & 15);
+      manager.fill(name, 0, 1, pulse); }, pulse.size());
+  run("pulse by handle", events, [&](unsigned long ii) { manager.fill(histPulse[ii & 15], 0, 1, pulse); }, pulse.size());
+  return 0;
+}
@@ -0,0 +1,204 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+/**
+ * Times the monitoring hot paths on synthetic events, so that it runs in the emulation
+ * build without hardware or a running DAQ:
+ *  - unpacking the event header and fragment table (the EventView that
+ *    MonitorBaseModule::unpack_event_header wraps), and decoding a fragment of each format
+ *  - filling the fragment error histogram from a status word, by bin as MonitorBaseModule
+ *    does and by label
+ *  - building the messages publishing 1k and 4k bin histograms, in full and as deltas, and
+ *    a mostly empty hit map with and without compression
+ * Histogram fills by name, by handle and in bulk are timed by HistogramFillBenchmark.
+ *
+ * Usage: MonitoringBenchmark [iterations per test]
+ */
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EventFormats/DAQFormats.hpp"
+#include "EventFormats/RawExampleFormat.hpp"
+#include "EventFormats/TLBDataFragment.hpp"
+#include "EventFormats/TLBMonitoringFragment.hpp"
+#include "EventFormats/DigitizerDataFragment.hpp"
+#include "EventFormats/TrackerDataFragment.hpp"
+#include "Modules/MonitorBase/EventView.hpp"
+#include "Modules/MonitorBase/FragmentErrors.hpp"
+#include "Utils/HistogramManager.hpp"
+
+using namespace DAQFormats;
+using namespace TLBDataFormat;
+using namespace TLBMonFormat;
+
+namespace {
+  template<typename F>
+  void run(const std::string& test, unsigned long calls, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long ii = 0; ii < calls; ii++) f(ii);
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << std::left << std::setw(40) << test << std::right << std::setw(12)
+              << std::fixed << std::setprecision(3) << elapsed.count()/calls << " us/call" << std::endl;
+  }
+
+  /// Serialised event with the given fragments, as sent by the event builder
+  std::vector<uint8_t> make_event(uint8_t tag, const std::vector<std::pair<uint32_t,std::vector<uint32_t>>>& fragments) {
+    EventFull event(tag, 1, 1);
+    for (auto& fragment : fragments)
+      event.addFragment(new EventFragment(tag, fragment.first, 1, 100, fragment.second.data(), fragment.second.size()*sizeof(uint32_t)));
+    std::unique_ptr<byteVector> bytes(event.raw());
+    return *bytes;
+  }
+
+  /// CAEN VX1730 event: four header words, then per channel two 14-bit samples per word
+  std::vector<uint32_t> digitizer_payload(unsigned channels, unsigned samples) {
+    unsigned words = 4+channels*samples/2;
+    std::vector<uint32_t> payload(words);
+    payload[0] = 0xA0000000 | words;
+    payload[1] = ((1u<<channels)-1) & 0xFF;       // channel mask 0-7
+    payload[2] = (((1u<<channels)-1) & 0xFF00)<<16 | 1; // channel mask 8-15, event counter
+    payload[3] = 12345;                             // trigger time tag
+    for (unsigned ch = 0; ch < channels; ch++) {
+      for (unsigned ii = 0; ii < samples; ii += 2) {
+        uint32_t s0 = 15000-(ii > 300 && ii < 320 ? 2000 : 0)+(ii*7+ch)%13;
+        uint32_t s1 = 15000-(ii > 300 && ii < 320 ? 2000 : 0)+(ii*11+ch)%13;
+        payload[4+ch*samples/2+ii/2] = s0 | s1<<16;
+      }
+    }
+    return payload;
+  }
+
+  /// Decodes a fragment of every event once, reports formats the synthetic payload does not pass
+  template<typename T>
+  bool decodes(const std::string& format, const FragmentView* fragment) {
+    try {
+      T decoded(fragment->payload<const uint32_t*>(), fragment->payload_size());
+      return true;
+    } catch (std::exception& e) {
+      std::cout << std::left << std::setw(40) << ("decode "+format) << "  skipped, synthetic payload rejected: " << e.what() << std::endl;
+      return false;
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  unsigned long calls = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000;
+
+  // synthetic events: sizes as in physics running, contents only as realistic as needed to decode
+  const unsigned kTRBs = 9;
+  std::vector<std::pair<uint32_t,std::vector<uint32_t>>> fragments;
+  fragments.push_back({TriggerSourceID, std::vector<uint32_t>(8, 0)});
+  fragments.push_back({PMTSourceID, digitizer_payload(16, 600)});
+  for (unsigned trb = 0; trb < kTRBs; trb++) fragments.push_back({TrackerSourceID+trb, std::vector<uint32_t>(80, 0)});
+  auto physics = make_event(PhysicsTag, fragments);
+  auto tlbMonitoring = make_event(TLBMonitoringTag, {{TriggerSourceID, std::vector<uint32_t>(40, 0)}});
+  RawFragment raw;
+  raw.type = 0;
+  raw.source_id = 0;
+  raw.event_id = 1;
+  raw.bc_id = 100;
+  raw.dataLength = 400;
+  for (unsigned ii = 0; ii < raw.dataLength/4; ii++) raw.data[ii] = ii;
+  auto emulator = make_event(PhysicsTag, {{0, std::vector<uint32_t>(reinterpret_cast<const uint32_t*>(&raw), reinterpret_cast<const uint32_t*>(&raw)+raw.sizeBytes()/4)}});
+  std::cout << "Events: physics " << physics.size() << " bytes, TLB monitoring " << tlbMonitoring.size()
+            << " bytes, emulator " << emulator.size() << " bytes" << std::endl;
+
+  EventView event;
+  run("unpack event header (physics)", calls, [&](unsigned long) { event.reset(physics.data(), physics.size()); });
+  run("unpack event header (TLB monitoring)", calls, [&](unsigned long) { event.reset(tlbMonitoring.data(), tlbMonitoring.size()); });
+  run("unpack event header (emulator)", calls, [&](unsigned long) { event.reset(emulator.data(), emulator.size()); });
+  event.reset(physics.data(), physics.size());
+  run("find all fragments (physics)", calls, [&](unsigned long) {
+      for (auto& fragment : fragments) if (!event.find_fragment(fragment.first)) std::abort(); });
+
+  const FragmentView* pmt = event.find_fragment(PMTSourceID);
+  if (decodes<DigitizerDataFragment>("digitizer", pmt)) {
+    run("decode digitizer", calls/10, [&](unsigned long) { DigitizerDataFragment decoded(pmt->payload<const uint32_t*>(), pmt->payload_size()); });
+    DigitizerDataFragment decoded(pmt->payload<const uint32_t*>(), pmt->payload_size());
+    run("digitizer samples of 16 channels", calls/10, [&](unsigned long) {
+        for (int ch = 0; ch < 16; ch++) if (decoded.channel_has_data(ch)) decoded.channel_adc_counts(ch); });
+  }
+  const FragmentView* tlb = event.find_fragment(TriggerSourceID);
+  if (decodes<TLBDataFragment>("TLB data", tlb))
+    run("decode TLB data", calls, [&](unsigned long) { TLBDataFragment decoded(tlb->payload<const uint32_t*>(), tlb->payload_size()); });
+  const FragmentView* trb = event.find_fragment(TrackerSourceID);
+  if (decodes<TrackerDataFragment>("tracker", trb))
+    run("decode tracker (all TRBs)", calls/10, [&](unsigned long) {
+        for (unsigned ii = 0; ii < kTRBs; ii++) {
+          const FragmentView* fragment = event.find_fragment(TrackerSourceID+ii);
+          TrackerDataFragment decoded(fragment->payload<const uint32_t*>(), fragment->payload_size());
+        } });
+  event.reset(tlbMonitoring.data(), tlbMonitoring.size());
+  const FragmentView* tlbMon = event.find_fragment(TriggerSourceID);
+  if (decodes<TLBMonitoringFragment>("TLB monitoring", tlbMon))
+    run("decode TLB monitoring", calls, [&](unsigned long) { TLBMonitoringFragment decoded(tlbMon->payload<const uint32_t*>(), tlbMon->payload_size()); });
+  event.reset(emulator.data(), emulator.size());
+  const FragmentView* rawFragment = event.find_fragment(0);
+  volatile uint32_t sink = 0;
+  run("read emulator raw fragment", calls, [&](unsigned long) {
+      auto data = rawFragment->payload<const RawFragment*>();
+      sink = data->bc_id+data->dataLength; });
+
+  HistogramManager manager("MonitoringBenchmark");
+  manager.configure(1, "tcp://localhost:5555"); // never started: messages are built, not sent
+
+  // fragment error accounting with the tables of MonitorBaseModule: one bin per status bit, or a fill by label
+  using namespace FragmentErrors;
+  auto errors = manager.registerHistogram("fragment_errors", "error type", kCategories);
+  std::vector<int> bins;
+  for (auto label : kLabels) bins.push_back(manager.categoryBin(errors, label));
+  const uint32_t status = BCIDMismatch | MissingFragment;
+  run("fragment errors by bin", calls, [&](unsigned long) {
+      for (uint32_t bits = status & ((1u<<kErrorBits)-1); bits; bits &= bits-1)
+        manager.fillBin(errors, bins[__builtin_ctz(bits)]); });
+  run("fragment errors by label", calls, [&](unsigned long) {
+      for (uint32_t bits = status & ((1u<<kErrorBits)-1); bits; bits &= bits-1)
+        manager.fill("fragment_errors", kLabels[__builtin_ctz(bits)]); });
+
+  // publishing: JSON and binary, in full and (with keyframes) only the changed bins
+  for (bool binary : {false, true}) {
+    HistogramManager publisher(binary ? "binary" : "json");
+    publisher.configure(1, "tcp://localhost:5555");
+    publisher.setBinaryFormat(binary);
+    auto hist1k = publisher.registerHistogram("hist1k", "x", 0, 1000, 1000);
+    auto hist4k = publisher.registerHistogram("bcid", "BCID", -0.5, 4095.5, 4096);
+    for (unsigned ii = 0; ii < 100000; ii++) {
+      publisher.fill(hist1k, ii%1000, 1+ii%3);
+      publisher.fill(hist4k, (ii*7)%4096);
+    }
+    std::string format = binary ? " (binary)" : " (JSON)";
+    run("publish 1k bins"+format, calls/100, [&](unsigned long) { publisher.publish(hist1k.hist); });
+    run("publish 4k bins"+format, calls/100, [&](unsigned long) { publisher.publish(hist4k.hist); });
+    publisher.setKeyframeInterval(1000000);
+    publisher.publish(hist4k.hist); // first publication is in full
+    run("publish 4k bins, 10 changed"+format, calls/100, [&](unsigned long ii) {
+        for (unsigned bin = 0; bin < 10; bin++) publisher.fill(hist4k, (ii*10+bin)%4096);
+        publisher.publish(hist4k.hist); });
+    run("publish 4k bins, unchanged"+format, calls/100, [&](unsigned long) { publisher.publish(hist4k.hist); });
+    auto& stats = publisher.publishStats();
+    std::cout << "  " << stats.full << " full, " << stats.deltas << " delta and " << stats.skipped << " skipped publications" << std::endl;
+  }
+
+  // compression of a mostly empty hit map, as the tracker hit maps
+  for (bool binary : {false, true}) {
+    HistogramManager publisher(binary ? "binary" : "json");
+    publisher.configure(1, "tcp://localhost:5555");
+    publisher.setBinaryFormat(binary);
+    auto hitmap = publisher.register2DHistogram("hitmap", "x", 0, 128, 128, "y", 0, 128, 128);
+    for (unsigned ii = 0; ii < 500; ii++) publisher.fill2D(hitmap, (ii*13)%128, (ii*7)%128);
+    std::string format = binary ? " (binary)" : " (JSON)";
+    run("publish 128x128 hit map"+format, calls/1000, [&](unsigned long) { publisher.publish(hitmap.hist); });
+    size_t bytes = hitmap.hist->publish_bytes;
+    publisher.setCompression(1024);
+    run("publish 128x128 hit map, zlib"+format, calls/1000, [&](unsigned long) { publisher.publish(hitmap.hist); });
+    auto& stats = publisher.publishStats();
+    std::cout << "  " << bytes << " -> " << hitmap.hist->publish_bytes << " bytes, compression ratio " << stats.compression_ratio
+              << ", " << float(stats.compress_us)/stats.compressed << " us per compression" << std::endl;
+  }
+  return 0;
+}
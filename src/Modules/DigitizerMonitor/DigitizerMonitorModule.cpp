@@ -42,12 +42,12 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
   if (evtHeaderUnpackStatus) return;
 
   // consistency check that the event received is the type of data we are configured to take
-  if ( m_event->event_tag() != m_eventTag ) {
+  if ( m_event.event_tag() != m_eventTag ) {
     ERROR("Event tag does not match filter tag. Are the module's filter settings correct?");
     return;
   }
 
-  auto tlb = get_tlb_data_fragment(eventBuilderBinary);
+  const auto& tlb = get_tlb_data_fragment(eventBuilderBinary);
 
   //auto fragmentUnpackStatus = unpack_fragment_header(eventBuilderBinary); // if only monitoring information in header.
   auto fragmentUnpackStatus = unpack_full_fragment(eventBuilderBinary);
@@ -65,7 +65,7 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
 
   // size of fragment payload
   uint16_t payloadSize = m_fragment->payload_size(); 
-  m_histogrammanager->fill("h_digitizer_payloadsize", payloadSize);
+  m_histogrammanager->fill(m_hist_payloadsize, payloadSize);
   m_metric_payload = payloadSize;
 
   float peaks[NCHANNELS];
@@ -80,8 +80,6 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
   bool saturated=false;
   for(int iChan=0; iChan<NCHANNELS; iChan++){
     if (!m_pmtdataFragment->channel_has_data(iChan)) continue;
-    std::string chStr = std::to_string(iChan);
-    if (iChan<10) chStr = "0"+chStr;
 
     auto v = m_pmtdataFragment->channel_adc_counts(iChan);
 
@@ -91,8 +89,14 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
     float rms = GetPedestalRMS(v, 0, 50);
     
     m_avg[iChan]=avg;
-    if (m_rms[iChan]==0) m_rms[iChan]=rms; //initialize on first event
-    m_rms[iChan]=0.02*rms+0.98*m_rms[iChan]; //exponential moving average
+    if (m_trend_pedestal[iChan]) m_histogrammanager->fill(m_trend_pedestal[iChan], avg);
+    m_histogrammanager->fill(m_prof_pedestal_mean, iChan, avg);
+    m_histogrammanager->fill(m_prof_pedestal_rms, iChan, rms);
+    {
+      std::lock_guard<std::mutex> lock(m_average_mutex);
+      if (m_rms[iChan]==0) m_rms[iChan]=rms; //initialize on first event
+      m_rms[iChan]=0.02*rms+0.98*m_rms[iChan]; //exponential moving average
+    }
 
     //convert to mV and find peaks
     std::vector<float>& signal=signals[iChan];
@@ -123,13 +127,13 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
     tzeros[iChan]=t0;
     // example pulse
     if ((-min_value)>m_display_thresh||(max_value>m_display_thresh)) {
-      FillChannelPulse("h_pulse_ch"+chStr, signal);
+      FillChannelPulse(m_hist_pulse[iChan], signal);
     }
     float peak=max_value;
     peaks[iChan]=peak;
     if ((-min_value)>peak) peak=min_value;
 
-    m_histogrammanager->fill("h_peak_ch"+chStr, peak, 1.0); 
+    m_histogrammanager->fill(m_hist_peak[iChan], peak, 1.0); 
     for(int ii=0;ii<THRESHOLDS;ii++) {
       if (m_thresholds[iChan][ii] && peak>m_thresholds[iChan][ii])  
 	m_thresh_counts[iChan][ii]++;
@@ -142,19 +146,20 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
     if (m_pmtdataFragment->channel_has_data(15)&&!saturated) { //assume that clock data is here
       float phase=FFTPhase(signals[15]);
       if (phase<-5) phase+=25;
-      m_histogrammanager->fill("h_clockphase", phase);
+      m_histogrammanager->fill(m_hist_clockphase, phase);
 
       for(int iChan=0; iChan<NCHANNELS; iChan++){
 	if (iChan==15) continue;
 	if (peaks[iChan]<5) continue; // Need a minimum signal
 
-	std::string chStr = std::to_string(iChan);
-	if (iChan<10) chStr = "0"+chStr;
-	
 	float t0=tzeros[iChan]-phase-float(m_cfg_nominal_t0[iChan]);
-	m_histogrammanager->fill("h_time_ch"+chStr,t0);
-	if (fabs(t0-m_t0[iChan])<10) // reject outliers, relying on being centered at 0
+	m_histogrammanager->fill(m_hist_time[iChan],t0);
+	std::lock_guard<std::mutex> lock(m_average_mutex);
+	if (fabs(t0-m_t0[iChan])<10) { // reject outliers, relying on being centered at 0
 	  m_t0[iChan]=0.02*t0+0.98*m_t0[iChan]; //exponential moving average
+	  if (m_trend_t0[iChan]) m_histogrammanager->fill(m_trend_t0[iChan], t0);
+	  m_histogrammanager->fill(m_prof_t0, iChan, t0);
+	}
       }
     }
     auto inputBitsNext = tlb.input_bits_next_clk();
@@ -175,7 +180,7 @@ void DigitizerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &e
 	  else if (inputBit>6) missedSignal=peaks[inputBit*2];
 	  else missedSignal=std::min(peaks[inputBit*2],peaks[inputBit*2+1]);
 	  m_late[inputBit]++;
-	  m_histogrammanager->fill("h_late_bit"+std::to_string(inputBit),missedSignal);
+	  m_histogrammanager->fill(m_hist_late[inputBit],missedSignal);
 	}
       }
     }
@@ -197,7 +202,7 @@ void DigitizerMonitorModule::register_hists() {
   
   m_display_thresh=(float)getModuleSettings()["display_thresh"];
   // payload size
-  m_histogrammanager->registerHistogram("h_digitizer_payloadsize", "payload size [bytes]", -0.5, 545.5, 275, m_PUBINT);
+  m_hist_payloadsize = m_histogrammanager->registerHistogram("h_digitizer_payloadsize", "payload size [bytes]", -0.5, 545.5, 275, m_PUBINT);
 
   // payload status
   std::vector<std::string> categories = {"Ok", "Unclassified", "BCIDMistmatch", "TagMismatch", "Timeout", "Overflow","Corrupted", "Dummy", "Missing", "Empty", "Duplicate", "DataUnpack"};
@@ -205,21 +210,35 @@ void DigitizerMonitorModule::register_hists() {
 
   // synthesis common for all channels
   int buffer_length = (int)getModuleSettings()["buffer_length"];
+  // optionally trends over trend_points intervals of trend_interval seconds, and peak and timing
+  // distributions of the last time_window seconds besides those of the whole run
+  unsigned trend_interval = getModuleSettings().value("trend_interval", 60);
+  unsigned trend_points = getModuleSettings().value("trend_points", 0);
+  unsigned time_window = getModuleSettings().value("time_window", 0);
   for(int iChan=0; iChan<NCHANNELS; iChan++){
     std::string chStr = std::to_string(iChan);
     if (iChan<10) chStr = "0"+chStr;
     // example pulse
-    m_histogrammanager->registerHistogram("h_pulse_ch"+chStr, "ADC Pulse ch"+std::to_string(iChan)+" Sample Number", "Inverted signal [mV]", -0.5, buffer_length-0.5, buffer_length, m_PUBINT);
-    m_histogrammanager->registerHistogram("h_peak_ch"+chStr, "Peak signal [mV]", -200, 2000, 550, m_PUBINT);
+    m_hist_pulse[iChan] = m_histogrammanager->registerHistogram("h_pulse_ch"+chStr, "ADC Pulse ch"+std::to_string(iChan)+" Sample Number", "Inverted signal [mV]", -0.5, buffer_length-0.5, buffer_length, m_PUBINT);
+    m_histogrammanager->noSamplingScale(m_hist_pulse[iChan]); // the last pulse only
+    m_hist_peak[iChan] = m_histogrammanager->registerHistogram("h_peak_ch"+chStr, "Peak signal [mV]", -200, 2000, 550, m_PUBINT);
+    if (time_window) m_histogrammanager->addTimeWindow(m_hist_peak[iChan], time_window);
+    if (trend_points) m_trend_pedestal[iChan] = m_histogrammanager->registerTrend("trend_pedestal_ch"+chStr, "Pedestal mean [ADC counts]", trend_points, trend_interval, m_PUBINT);
     if (iChan==15) continue;
-    m_histogrammanager->registerHistogram("h_time_ch"+chStr, "Peak timing [ns]", -30, 30, 300, m_PUBINT);
+    m_hist_time[iChan] = m_histogrammanager->registerHistogram("h_time_ch"+chStr, "Peak timing [ns]", -30, 30, 300, m_PUBINT);
+    if (time_window) m_histogrammanager->addTimeWindow(m_hist_time[iChan], time_window);
+    if (trend_points) m_trend_t0[iChan] = m_histogrammanager->registerTrend("trend_t0_ch"+chStr, "Signal timing [ns]", trend_points, trend_interval, m_PUBINT);
 
   }
+  // per channel means and spreads over the run
+  m_prof_pedestal_mean = m_histogrammanager->registerProfile("p_pedestal_mean", "channel", "Pedestal mean [ADC counts]", -0.5, NCHANNELS-0.5, NCHANNELS, m_PUBINT);
+  m_prof_pedestal_rms = m_histogrammanager->registerProfile("p_pedestal_rms", "channel", "Pedestal RMS [ADC counts]", -0.5, NCHANNELS-0.5, NCHANNELS, m_PUBINT);
+  m_prof_t0 = m_histogrammanager->registerProfile("p_signal_timing", "channel", "Signal timing [ns]", -0.5, NCHANNELS-1.5, NCHANNELS-1, m_PUBINT);
   for(int inputBit=0; inputBit<8;inputBit++) {
-    m_histogrammanager->registerHistogram("h_late_bit"+std::to_string(inputBit), "Peak signal for late triggers [mV]", 0, 500, 250, m_PUBINT);
+    m_hist_late[inputBit] = m_histogrammanager->registerHistogram("h_late_bit"+std::to_string(inputBit), "Peak signal for late triggers [mV]", 0, 500, 250, m_PUBINT);
 
   }
-  m_histogrammanager->registerHistogram("h_clockphase", "Clock phase [ns]", -50, 50, 500, m_PUBINT);
+  m_hist_clockphase = m_histogrammanager->registerHistogram("h_clockphase", "Clock phase [ns]", -50, 50, 500, m_PUBINT);
 
   
   INFO(" ... done registering histograms ... " );
@@ -328,7 +347,8 @@ void DigitizerMonitorModule::CheckBounds(std::vector<uint16_t> input, int& start
   }
 }
 
-void DigitizerMonitorModule::FillChannelPulse(std::string histogram_name, std::vector<float>& values){
-  m_histogrammanager->reset(histogram_name);
-  m_histogrammanager->fill(histogram_name,0,1,values);
+void DigitizerMonitorModule::FillChannelPulse(Hist1DHandle histogram, const std::vector<float>& values){
+  std::lock_guard<std::mutex> lock(m_average_mutex); // keep reset and fill together
+  m_histogrammanager->reset(histogram);
+  m_histogrammanager->fill(histogram,0,1,ValueSpan<float>(values)); // one sample per bin
 }
@@ -6,6 +6,7 @@
 #include "Modules/MonitorBase/MonitorBaseModule.hpp"
 
 #include <cmath>
+#include <mutex>
 #include <cstdint>
 #define NCHANNELS 16
 #define THRESHOLDS 4
@@ -22,17 +23,19 @@ class DigitizerMonitorModule : public MonitorBaseModule {
 
   float FFTPhase(const std::vector<float>& data);
 
-  void FillChannelPulse(std::string histogram_name, std::vector<float>& values);
+  void FillChannelPulse(Hist1DHandle histogram, const std::vector<float>& values);
   float m_display_thresh;
  protected:
 
   void monitor(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
+  bool supportsWorkerThreads() const override { return true; }
   void register_hists();
   void register_metrics();
   float m_thresholds[NCHANNELS][THRESHOLDS];
-  int m_intime[8];
-  int m_late[8];
-  int m_early[8];
+  std::atomic<int> m_intime[8];
+  std::atomic<int> m_late[8];
+  std::atomic<int> m_early[8];
+  std::mutex m_average_mutex; // moving averages and pulse displays are updated from several workers
   std::atomic<float> m_avg[NCHANNELS];
   std::atomic<float> m_rms[NCHANNELS];
   std::atomic<float> m_t0[NCHANNELS];
@@ -42,6 +45,18 @@ class DigitizerMonitorModule : public MonitorBaseModule {
   std::atomic<int> m_collisionLike;
   std::atomic<int> m_saturatedCollisions;
 
+  Hist1DHandle m_hist_payloadsize;
+  Hist1DHandle m_hist_pulse[NCHANNELS];
+  Hist1DHandle m_hist_peak[NCHANNELS];
+  Hist1DHandle m_hist_time[NCHANNELS];
+  Hist1DHandle m_hist_late[8];
+  Hist1DHandle m_hist_clockphase;
+  TrendHandle m_trend_pedestal[NCHANNELS];
+  TrendHandle m_trend_t0[NCHANNELS];
+  ProfileHandle m_prof_pedestal_mean;
+  ProfileHandle m_prof_pedestal_rms;
+  ProfileHandle m_prof_t0;
+
   nlohmann::json m_cfg_min_collisions;
   nlohmann::json m_cfg_nominal_t0;
 };
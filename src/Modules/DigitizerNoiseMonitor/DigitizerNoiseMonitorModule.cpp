@@ -33,7 +33,7 @@ void DigitizerNoiseMonitorModule::monitor(DataFragment<daqling::utilities::Binar
   if (evtHeaderUnpackStatus) return;
 
   // consistency check that the event received is the type of data we are configured to take
-  if ( m_event->event_tag() != m_eventTag ) {
+  if ( m_event.event_tag() != m_eventTag ) {
     ERROR("Event tag does not match filter tag. Are the module's filter settings correct?");
     return;
   }
@@ -222,6 +222,12 @@ void DigitizerReceiverModule::configure() {
   registerVariable(m_time_read,     "time_RetrieveEvents");
   registerVariable(m_time_parse,    "time_ParseEvents");
   registerVariable(m_time_overhead, "time_Overhead");
+  registerVariable(m_time_send,     "time_SendEvents");
+
+  registerVariable(m_ring_occupancy, "ReadoutRingOccupancy");
+  registerVariable(m_ring_stalls,    "ReadoutRingStalls", metrics::RATE);
+  registerVariable(m_reader_busy_us, "ReaderBusy_us", metrics::RATE);
+  registerVariable(m_parser_busy_us, "ParserBusy_us", metrics::RATE);
 
   registerVariable(m_corrupted_events, "CorruptedEvents");
   registerVariable(m_empty_events, "EmptyEvents");
@@ -312,6 +318,9 @@ void DigitizerReceiverModule::sendECR() {
 
   // stop acquisition
   m_digitizer->StopAcquisition();
+
+  // send all events read before the ECR first
+  while (m_ring_occupancy>0) std::this_thread::sleep_for(std::chrono::microseconds(100));
   
   // restart acquisition to reset event counter
   m_digitizer->StartAcquisition();
@@ -426,6 +435,9 @@ void DigitizerReceiverModule::runner() noexcept {
   auto cfg = getModuleSettings();
   m_prev_event_id=0;
 
+  // filled by the block transfers, m_monitoring by the parsing
+  std::map<std::string, float> read_monitoring;
+
   // for reading the buffer
   m_readout_method = (std::string)cfg["readout"]["readout_method"];
   m_readout_blt    = (int)cfg["readout"]["readout_blt"];
@@ -440,12 +452,30 @@ void DigitizerReceiverModule::runner() noexcept {
   // size of the buffer in samples for a single channel
   DEBUG("Getting buffer size");
   int buffer_size = m_digitizer->RetrieveBufferLength();
-  int m_event_size =  ((buffer_size/2)*nchannels_enabled)+4; //should check this from digitizer
+  m_event_size =  ((buffer_size/2)*nchannels_enabled)+4; //should check this from digitizer
   INFO("Expected event size: "<<m_event_size<<" words");
   // maximum number of events to be requested
   DEBUG("Getting readout request size");
   m_n_events_requested = m_readout_blt;
-  unsigned int* m_raw_payload = new unsigned int[m_event_size*m_n_events_requested];
+
+  // ring of readout buffers between runner() and parser(), off by default: parsing then runs
+  // concurrently with the readout on the same vx1730, whose thread safety is not established
+  m_ring_size = cfg["readout"].value("ring_buffers", 0u);
+  m_blocks.assign(std::max(1u, m_ring_size), ReadoutBlock());
+  for (auto& block : m_blocks) block.payload.resize(m_event_size*m_n_events_requested);
+  m_ring_occupancy = 0;
+  m_reader_busy_ns = 0;
+  m_parser_busy_ns = 0;
+  m_reader_busy_us = 0;
+  m_parser_busy_us = 0;
+  if (m_ring_size) {
+    INFO("Reading out into "<<m_ring_size<<" buffers of "<<m_n_events_requested<<" events, parsed on a separate thread");
+    m_free_blocks = std::make_unique<BlockQueue>(m_ring_size+1); // holds one less than its size
+    m_filled_blocks = std::make_unique<BlockQueue>(m_ring_size+1);
+    for (unsigned int index = 0; index < m_ring_size; index++) m_free_blocks->write(index);
+    m_stop_parser = false;
+    m_parser = std::thread(&DigitizerReceiverModule::parser, this);
+  }
   // start time
   auto time_start = chrono::high_resolution_clock::now();
   int last_check_count = 0;
@@ -460,7 +490,7 @@ void DigitizerReceiverModule::runner() noexcept {
       m_status = STATUS_ERROR;
     }
   }
-  uint32_t bobr_id=0;
+  m_bobr_id=0;
   // the polling loop
   while (m_run) {    
 
@@ -479,6 +509,7 @@ void DigitizerReceiverModule::runner() noexcept {
     // polling of the hardware - if any number of events is detected
     // then all events in the buffer are read out
     int n_events_present = 0;
+    auto time_poll = chrono::steady_clock::now();
     try {
       n_events_present = m_digitizer->DumpEventCount();
     } catch (DigitizerHardwareException &e) {
@@ -495,25 +526,31 @@ void DigitizerReceiverModule::runner() noexcept {
     m_hw_buffer_occupancy = n_events_present;
     bool shouldsleep = (n_events_present==0);
     float read_time=0;
-    float parse_time=0;
     int receivedEvents=0;
+    m_reader_busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-time_poll).count();
+    m_reader_busy_us = m_reader_busy_ns/1000;
     //    int time_now   = (chrono::duration_cast<chrono::nanoseconds>(chrono::high_resolution_clock::now() - time_start).count() * 1e-6)/1000;
     while(n_events_present){
       DEBUG("[Running] - Reading events : totalEvents = "<<std::dec<<n_events_present<<"  eventsRequested = "<<std::dec<<m_n_events_requested);
       DEBUG("With m_ECRcount : "<<m_ECRcount);
       
       // clear the monitoring map which will retrieve the info to pass to monitoring metrics
-      m_monitoring.clear();
+      read_monitoring.clear();
               
-      // get the data from the board into the software buffer        
+      // get the data from the board into the next free buffer, waiting for one if the parser is behind
+      unsigned int index = waitForFreeBlock();
+      ReadoutBlock& block = m_blocks[index];
       int nwords_obtained = 0;
-      int nerrors = 0;
-      int events_to_do = std::min(n_events_present,m_n_events_requested);
+      block.nerrors = 0;
+      block.events = std::min(n_events_present,m_n_events_requested);
 
-      nwords_obtained = m_digitizer->ReadSingleEvent(m_raw_payload, events_to_do*m_event_size, m_monitoring, nerrors,
+      auto time_read = chrono::steady_clock::now();
+      nwords_obtained = m_digitizer->ReadSingleEvent(block.payload.data(), block.events*m_event_size, read_monitoring, block.nerrors,
 						     m_readout_method, false);
-      read_time+=m_monitoring["block_readout_time"];
-      receivedEvents+=events_to_do;
+      m_reader_busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-time_read).count();
+      m_reader_busy_us = m_reader_busy_ns/1000;
+      read_time+=read_monitoring["block_readout_time"];
+      receivedEvents+=block.events;
       if (nwords_obtained==0) { //most likely reqest didn't arrive at VME card
 	m_empty_events++;
 	if (m_empty_events==5) {
@@ -524,48 +561,20 @@ void DigitizerReceiverModule::runner() noexcept {
 	  ERROR("Failed to retrieve at least 50 events - problem communicating with digitizer - Call Brian...");
 	  m_status = STATUS_ERROR;
 	}
-	continue;
+	continue; // the buffer stays free
       }
-      if ((nwords_obtained!=m_event_size*events_to_do)&&(nerrors==0)) {
-	WARNING("Got "<<nwords_obtained<<" words while expecting "<<m_event_size*events_to_do<<" words, but no errors?");
-	nerrors=1;
+      if ((nwords_obtained!=m_event_size*block.events)&&(block.nerrors==0)) {
+	WARNING("Got "<<nwords_obtained<<" words while expecting "<<m_event_size*block.events<<" words, but no errors?");
+	block.nerrors=1;
       }
       // count triggers sent
-      m_triggers +=events_to_do;
-      // parse the events and decorate them with a FASER header
+      m_triggers +=block.events;
+      n_events_present-=block.events;
 
-      for(int i_evnt=0;i_evnt<events_to_do;i_evnt++) {
-	auto fragment = m_digitizer->ParseEventSingle(m_raw_payload+i_evnt*m_event_size, m_event_size, 
-						      m_monitoring, 
-						      m_ECRcount, m_ttt_converter, m_bcid_ttt_fix, nerrors);
-
-	parse_time+=m_monitoring["time_parse_time"];
-
-	// send vent to event builder
-	if (fragment->event_id()!=m_prev_event_id+1) {
-	  WARNING("Got fragment "<<fragment->event_id()<<" was expecting: "<<m_prev_event_id+1);
-	}
-	m_prev_event_id=fragment->event_id();
-	if (fragment->status()) {
-	  m_corrupted_events++;
-	  if (m_corrupted_events==5) {
-	    ERROR("Got several corrupted events");
-	    m_status = STATUS_WARN;
-	  }
-	  if (m_corrupted_events>=50) {
-	    ERROR("Got at least 50 events - problem communicating with digitizer - Call Brian...");
-	    m_status = STATUS_ERROR;
-	  }
-
-	}
-
-
-	// place the raw binary event fragment on the output port
-	std::unique_ptr<const byteVector> bytestream(fragment->raw());
-	DataFragment<daqling::utilities::Binary> binData(bytestream->data(),bytestream->size());
-	m_connections.send(0, binData);  
-      }
-      n_events_present-=events_to_do;
+      // the parser decorates the events with a FASER header and sends them
+      block.ecr = m_ECRcount;
+      block.bobr = false;
+      queueBlock(index);
     }
     m_lock.unlock();
 
@@ -575,7 +584,6 @@ void DigitizerReceiverModule::runner() noexcept {
       usleep(1000); 
     } else {
       m_time_read = read_time/receivedEvents;
-      m_time_parse = parse_time/receivedEvents;
     }
 
 
@@ -639,21 +647,130 @@ void DigitizerReceiverModule::runner() noexcept {
 	if (!readBOBR()) {
 	  ERROR("Failed to read BOBR data");
 	} else {
-	  std::unique_ptr<EventFragment> fragment(new EventFragment(EventTags::MonitoringTag,
-								    SourceIDs::BOBRSourceID,
-								    bobr_id++,0,&m_bobrdata,sizeof(m_bobrdata)));
-	  std::unique_ptr<const byteVector> bytestream(fragment->raw());
-	  DataFragment<daqling::utilities::Binary> binData(bytestream->data(),bytestream->size());
-	  m_connections.send(0, binData);  
+	  // sent by the parser, in order with the events
+	  unsigned int index = waitForFreeBlock();
+	  m_blocks[index].bobr = true;
+	  m_blocks[index].bobrdata = m_bobrdata;
+	  queueBlock(index);
 	}
       }
     }
 
   }
   
-  // delete the memory that was allocated
-  delete [] m_raw_payload;  
-  m_raw_payload = NULL;     
+  // send what is left in the ring
+  if (m_parser.joinable()) {
+    m_stop_parser = true;
+    m_parser.join();
+  }
+  m_free_blocks.reset();
+  m_filled_blocks.reset();
+  m_blocks.clear();
   
   INFO("Runner stopped");
 }
+
+/**
+ * Index of the next free readout buffer, waiting while all of them are queued for the parser.
+ */
+unsigned int DigitizerReceiverModule::waitForFreeBlock() {
+  if (!m_ring_size) return 0;
+  unsigned int* index = m_free_blocks->frontPtr();
+  if (!index) {
+    m_ring_stalls++;
+    while (!(index = m_free_blocks->frontPtr())) std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+  return *index;
+}
+
+/**
+ * Hands the buffer returned by waitForFreeBlock() to the parser, or without a ring
+ * parses and sends it right away.
+ */
+void DigitizerReceiverModule::queueBlock(unsigned int index) {
+  if (!m_ring_size) {
+    processBlock(m_blocks[index]);
+    return;
+  }
+  m_ring_occupancy++;
+  m_filled_blocks->write(index); // cannot be full: there are only m_ring_size buffers
+  m_free_blocks->popFront();
+}
+
+void DigitizerReceiverModule::parser() noexcept {
+  INFO("Parser started");
+  // finish the queued blocks after the run is stopped
+  while (!m_stop_parser || !m_filled_blocks->isEmpty()) {
+    unsigned int* index = m_filled_blocks->frontPtr();
+    if (!index) {
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+      continue;
+    }
+    unsigned int done = *index;
+    processBlock(m_blocks[done]);
+    m_free_blocks->write(done);
+    m_filled_blocks->popFront();
+    m_ring_occupancy--;
+  }
+  INFO("Parser stopped");
+}
+
+/**
+ * Parses the events of a readout buffer, decorates them with a FASER header and sends them
+ * to the event builder, or sends the BOBR data of the buffer.
+ */
+void DigitizerReceiverModule::processBlock(ReadoutBlock& block) {
+  auto time_start = chrono::steady_clock::now();
+  if (block.bobr) {
+    std::unique_ptr<EventFragment> fragment(new EventFragment(EventTags::MonitoringTag,
+							      SourceIDs::BOBRSourceID,
+							      m_bobr_id++,0,&block.bobrdata,sizeof(block.bobrdata)));
+    std::unique_ptr<const byteVector> bytestream(fragment->raw());
+    DataFragment<daqling::utilities::Binary> binData(bytestream->data(),bytestream->size());
+    m_connections.send(0, binData);  
+    m_parser_busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-time_start).count();
+    m_parser_busy_us = m_parser_busy_ns/1000;
+    return;
+  }
+
+  m_monitoring.clear();
+  float parse_time=0;
+  float send_time=0;
+  for(int i_evnt=0;i_evnt<block.events;i_evnt++) {
+    auto fragment = m_digitizer->ParseEventSingle(block.payload.data()+i_evnt*m_event_size, m_event_size, 
+						  m_monitoring, 
+						  block.ecr, m_ttt_converter, m_bcid_ttt_fix, block.nerrors);
+
+    parse_time+=m_monitoring["time_parse_time"];
+
+    // send vent to event builder
+    if (fragment->event_id()!=m_prev_event_id+1) {
+      WARNING("Got fragment "<<fragment->event_id()<<" was expecting: "<<m_prev_event_id+1);
+    }
+    m_prev_event_id=fragment->event_id();
+    if (fragment->status()) {
+      m_corrupted_events++;
+      if (m_corrupted_events==5) {
+	ERROR("Got several corrupted events");
+	m_status = STATUS_WARN;
+      }
+      if (m_corrupted_events>=50) {
+	ERROR("Got at least 50 events - problem communicating with digitizer - Call Brian...");
+	m_status = STATUS_ERROR;
+      }
+
+    }
+
+
+    // place the raw binary event fragment on the output port
+    auto time_send = chrono::steady_clock::now();
+    std::unique_ptr<const byteVector> bytestream(fragment->raw());
+    DataFragment<daqling::utilities::Binary> binData(bytestream->data(),bytestream->size());
+    m_connections.send(0, binData);  
+    send_time+=chrono::duration<float,std::micro>(chrono::steady_clock::now()-time_send).count();
+  }
+  m_time_parse = parse_time/block.events;
+  m_time_send = send_time/block.events;
+  m_parser_busy_ns += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now()-time_start).count();
+  m_parser_busy_us = m_parser_busy_ns/1000;
+}
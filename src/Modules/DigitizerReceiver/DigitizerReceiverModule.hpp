@@ -16,6 +16,12 @@
 // needed for sendECR() and runner() protection
 #include <mutex>
 
+// two-stage readout
+#include <memory>
+#include <thread>
+#include <vector>
+#include "folly/ProducerConsumerQueue.h"
+
 ERS_DECLARE_ISSUE(
 DigitizerReceiver,                                                              // namespace
     DigitizerHardwareIssue,                                                    // issue name
@@ -54,6 +60,7 @@ class DigitizerReceiverModule : public FaserProcess {
   void stop();
   void sendECR();
   void runner() noexcept;
+  void parser() noexcept;
 
   ///////////////////////////////////////////
   // Digitizer specific methods and members
@@ -80,6 +87,30 @@ class DigitizerReceiverModule : public FaserProcess {
   // used to protect against the ECR and runner() from reading out at the same time
   std::mutex m_lock;
 
+  // two-stage readout: runner() only reads blocks of events from the board into a ring of
+  // preallocated buffers, parser() parses and sends them, so that transfer and parsing overlap
+  struct ReadoutBlock {
+    std::vector<unsigned int> payload; // m_readout_blt events of m_event_size words
+    int events = 0;
+    int nerrors = 0;
+    unsigned int ecr = 0;              // ECR count when the block was read
+    bool bobr = false;                 // BOBR data instead of events
+    BOBRDataFormat::BOBREventV1 bobrdata;
+  };
+  using BlockQueue = folly::ProducerConsumerQueue<unsigned int>;
+  unsigned int waitForFreeBlock();
+  void queueBlock(unsigned int index);
+  void processBlock(ReadoutBlock& block);
+
+  int m_event_size;
+  unsigned int m_ring_size;                  // 0: parse and send in runner()
+  std::vector<ReadoutBlock> m_blocks;
+  std::unique_ptr<BlockQueue> m_free_blocks;   // parser -> runner
+  std::unique_ptr<BlockQueue> m_filled_blocks; // runner -> parser
+  std::thread m_parser;
+  std::atomic<bool> m_stop_parser;
+  uint32_t m_bobr_id;
+
   // used for the trigger time to BCID conversion
   float m_ttt_converter;
   
@@ -113,6 +144,14 @@ class DigitizerReceiverModule : public FaserProcess {
   std::atomic<float> m_time_read;
   std::atomic<float> m_time_parse;
   std::atomic<float> m_time_overhead;
+  std::atomic<float> m_time_send;
+
+  std::atomic<int> m_ring_occupancy;  // blocks read but not yet sent
+  std::atomic<int> m_ring_stalls;     // reads delayed because all buffers were waiting for the parser
+  std::atomic<size_t> m_reader_busy_us; // whole us of m_reader_busy_ns, integers to stay exact in long runs
+  std::atomic<size_t> m_parser_busy_us;
+  uint64_t m_reader_busy_ns;
+  uint64_t m_parser_busy_ns;
   
   std::atomic<int> m_corrupted_events;
   std::atomic<int> m_empty_events;
@@ -30,7 +30,7 @@ void EmulatorMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &ev
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) return;
 
-  if ( m_event->event_tag() != m_eventTag ) {
+  if ( m_event.event_tag() != m_eventTag ) {
     ERROR("Event tag does not match filter tag. Are the module's filter settings correct?");
     return;
   }
@@ -46,27 +46,26 @@ void EmulatorMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &ev
   uint16_t payloadSize = m_fragment->payload_size(); 
 
   // 1D histogram fill
-  m_histogrammanager->fill("payloadsize", payloadSize);
+  m_histogrammanager->fill(m_hist_payloadsize, payloadSize);
   m_metric_payload = payloadSize;
 
-  m_histogrammanager->fill("sizefrag", m_monitoringFragment->size_fragments_sent/1000.);
+  m_histogrammanager->fill(m_hist_sizefrag, m_monitoringFragment->size_fragments_sent/1000.);
 
-  m_histogrammanager->reset("pulse");
+  m_histogrammanager->reset(m_hist_pulse);
   short amp = rand()%10+1;
   float phase = (PI/2.)*(rand()%10)/NBINS;
-  std::vector<short> adcs;
-  //std::vector<unsigned short> positions;
-  for ( unsigned short i = 1; i <= NBINS; i++) {
-    adcs.push_back(amp*sin( i*(PI/5.) + phase));
-    //positions.push_back(i);
+  short adcs[NBINS];
+  for ( unsigned short i = 0; i < NBINS; i++) {
+    adcs[i] = amp*sin( (i+1)*(PI/5.) + phase);
   }
-  //m_histogrammanager->fill("pulse", positions, adcs); // fill by providing both vectors for x values and weights. Around 15% slower compared to filling method one line down
-  m_histogrammanager->fill("pulse", 1, 1, adcs); 
+  // bulk fill of one sample per bin, starting at 1. ValueSpan also takes vectors, and a second
+  // span for the x values if they are not evenly spaced.
+  m_histogrammanager->fill(m_hist_pulse, 1, 1, ValueSpan<short>(adcs, NBINS)); 
 
   // 2D hist fill
   DEBUG("m_monitoringFragment->num_fragments_sent = "<<m_monitoringFragment->num_fragments_sent);
   DEBUG("m_monitoringFragment->size_fragments_sent/1000. = "<<m_monitoringFragment->size_fragments_sent/1000.);
-  m_histogrammanager->fill2D("numfrag_vs_sizefrag", m_monitoringFragment->num_fragments_sent, m_monitoringFragment->size_fragments_sent/1000.);
+  m_histogrammanager->fill2D(m_hist_numfrag_vs_sizefrag, m_monitoringFragment->num_fragments_sent, m_monitoringFragment->size_fragments_sent/1000.);
 
 }
 
@@ -77,17 +76,18 @@ void EmulatorMonitorModule::register_hists() {
   // example of 1D histogram: default is ylabel="counts" non-extendable axes (Axis::Range::NONEXTENDABLE & 60 second publishing interval.
   //m_histogrammanager->registerHistogram("h_tracker_payloadsize", "payload size [bytes]", -0.5, 545.5, 275);
   // example of 1D histogram with extendable x-axis, publishing interval of every 30 seconds.
-  m_histogrammanager->registerHistogram("payloadsize", "payload size [bytes]", "event count/2kB", -0.5, 349.5, 175, Axis::Range::EXTENDABLE, m_PUBINT);
+  m_hist_payloadsize = m_histogrammanager->registerHistogram("payloadsize", "payload size [bytes]", "event count/2kB", -0.5, 349.5, 175, Axis::Range::EXTENDABLE, m_PUBINT);
 
   // example 1D histogram with non-extendable axis and resetting after each publish
-  m_histogrammanager->registerHistogram("sizefrag", "size of sent fragments [kB]","count/2kB", -0.5, 349.5, 175, Axis::Range::NONEXTENDABLE, m_PUBINT);
+  m_hist_sizefrag = m_histogrammanager->registerHistogram("sizefrag", "size of sent fragments [kB]","count/2kB", -0.5, 349.5, 175, Axis::Range::NONEXTENDABLE, m_PUBINT);
   m_histogrammanager->resetOnPublish("sizefrag", true);
 
   // example pulse reset
-   m_histogrammanager->registerHistogram("pulse", "pulse in magic adc", 1, NBINS+1, NBINS, 5);
+   m_hist_pulse = m_histogrammanager->registerHistogram("pulse", "pulse in magic adc", 1, NBINS+1, NBINS, 5);
+   m_histogrammanager->noSamplingScale(m_hist_pulse); // the last pulse only
 
   // example 2D hist
-  m_histogrammanager->register2DHistogram("numfrag_vs_sizefrag", "no. of sent fragments", -0.5, 100.5, 101, "size of sent fragments [kB]", -0.5, 9.5, 20, m_PUBINT);
+  m_hist_numfrag_vs_sizefrag = m_histogrammanager->register2DHistogram("numfrag_vs_sizefrag", "no. of sent fragments", -0.5, 100.5, 101, "size of sent fragments [kB]", -0.5, 9.5, 20, m_PUBINT);
 
   INFO(" ... done registering histograms ... " );
 
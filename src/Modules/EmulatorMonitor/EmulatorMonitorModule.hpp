@@ -16,4 +16,10 @@ class EmulatorMonitorModule : public MonitorBaseModule {
   void register_hists( );
   void register_metrics();
 
+ private:
+  Hist1DHandle m_hist_payloadsize;
+  Hist1DHandle m_hist_sizefrag;
+  Hist1DHandle m_hist_pulse;
+  Hist2DHandle m_hist_numfrag_vs_sizefrag;
+
 };
@@ -0,0 +1,145 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <unistd.h>
+
+#include "EventIndex.hpp"
+
+namespace {
+  const char indexMagic[8] = {'F','A','S','E','R','I','D','X'};
+
+  // layout of the start of the event header, see DAQFormats
+  const size_t eventHeaderSize = 44;
+  const uint8_t eventMarker = 0xBB;
+
+  template<typename T> T get_le(const uint8_t* data, size_t pos) {
+    T value;
+    std::memcpy(&value,data+pos,sizeof(T));
+    return value;
+  }
+
+  template<typename T> void put_le(uint8_t* data, size_t& pos, T value) {
+    std::memcpy(data+pos,&value,sizeof(T));
+    pos+=sizeof(T);
+  }
+
+  template<typename T> void take_le(const uint8_t* data, size_t& pos, T& value) {
+    value=get_le<T>(data,pos);
+    pos+=sizeof(T);
+  }
+}
+
+std::vector<EventIndexEntry> EventIndex::build(std::istream& in) {
+  std::vector<EventIndexEntry> entries;
+  in.seekg(0,std::ios::end);
+  uint64_t fileSize=in.tellg();
+  uint8_t header[eventHeaderSize];
+  uint64_t offset=0;
+  while (offset+eventHeaderSize<=fileSize) {
+    in.seekg(offset);
+    if (!in.read(reinterpret_cast<char*>(header),eventHeaderSize)) break;
+    EventIndexEntry entry;
+    uint16_t headerSize=get_le<uint16_t>(header,6);
+    entry.offset=offset;
+    entry.size=headerSize+get_le<uint32_t>(header,8);
+    // stop at corrupted or truncated events, as the sequential reader would
+    if (header[0]!=eventMarker || headerSize<eventHeaderSize || offset+entry.size>fileSize) break;
+    entry.event_tag=header[1];
+    entry.trigger_bits=get_le<uint16_t>(header,2);
+    entry.event_id=get_le<uint64_t>(header,16);
+    entry.timestamp=get_le<uint64_t>(header,36);
+    entries.push_back(entry);
+    offset+=entry.size;
+  }
+  in.clear();
+  return entries;
+}
+
+std::vector<EventIndexEntry> EventIndex::get(const std::string& fileName, bool& rebuilt) {
+  std::vector<EventIndexEntry> entries;
+  rebuilt=false;
+  std::ifstream in(fileName,std::ios::binary|std::ios::ate);
+  if (!in.is_open()) return entries;
+  uint64_t fileSize=in.tellg();
+
+  std::string indexName=fileName+".idx";
+  if (load(indexName,fileSize,entries)) return entries;
+
+  entries=build(in);
+  rebuilt=true;
+  save(indexName,fileSize,entries); // not fatal if the data directory is read-only
+  return entries;
+}
+
+bool EventIndex::load(const std::string& indexName, uint64_t fileSize, std::vector<EventIndexEntry>& entries) {
+  std::ifstream in(indexName,std::ios::binary);
+  if (!in.is_open()) return false;
+  char magic[8];
+  uint32_t fileVersion, fileEntrySize;
+  uint64_t indexedSize, numEntries;
+  in.read(magic,sizeof(magic));
+  in.read(reinterpret_cast<char*>(&fileVersion),sizeof(fileVersion));
+  in.read(reinterpret_cast<char*>(&fileEntrySize),sizeof(fileEntrySize));
+  in.read(reinterpret_cast<char*>(&indexedSize),sizeof(indexedSize));
+  in.read(reinterpret_cast<char*>(&numEntries),sizeof(numEntries));
+  if (!in || std::memcmp(magic,indexMagic,sizeof(magic)) || fileVersion!=version ||
+      fileEntrySize!=entrySize || indexedSize!=fileSize) return false;
+  // a corrupted count must not allocate more than the index and the data file can hold
+  uint64_t entriesStart=in.tellg();
+  in.seekg(0,std::ios::end);
+  uint64_t indexSize=in.tellg();
+  if (!in || numEntries>fileSize/eventHeaderSize || numEntries>(indexSize-entriesStart)/entrySize) return false;
+  in.seekg(entriesStart);
+  std::vector<uint8_t> records(numEntries*entrySize);
+  if (!in.read(reinterpret_cast<char*>(records.data()),records.size())) return false;
+  entries.resize(numEntries);
+  size_t pos=0;
+  for(auto& entry : entries) {
+    take_le(records.data(),pos,entry.offset);
+    take_le(records.data(),pos,entry.size);
+    take_le(records.data(),pos,entry.event_tag);
+    take_le(records.data(),pos,entry.trigger_bits);
+    take_le(records.data(),pos,entry.event_id);
+    take_le(records.data(),pos,entry.timestamp);
+  }
+  return true;
+}
+
+bool EventIndex::save(const std::string& indexName, uint64_t fileSize, const std::vector<EventIndexEntry>& entries) {
+  // unique per writer, so processes or threads indexing the same file do not write into each other
+  std::string tmpName=indexName+".tmp."+std::to_string(getpid())+"."+
+                      std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  {
+    std::ofstream out(tmpName,std::ios::binary|std::ios::trunc);
+    if (!out.is_open()) return false;
+    uint64_t numEntries=entries.size();
+    std::vector<uint8_t> records(numEntries*entrySize);
+    size_t pos=0;
+    for(auto& entry : entries) {
+      put_le(records.data(),pos,entry.offset);
+      put_le(records.data(),pos,entry.size);
+      put_le(records.data(),pos,entry.event_tag);
+      put_le(records.data(),pos,entry.trigger_bits);
+      put_le(records.data(),pos,entry.event_id);
+      put_le(records.data(),pos,entry.timestamp);
+    }
+    out.write(indexMagic,sizeof(indexMagic));
+    out.write(reinterpret_cast<const char*>(&version),sizeof(version));
+    out.write(reinterpret_cast<const char*>(&entrySize),sizeof(entrySize));
+    out.write(reinterpret_cast<const char*>(&fileSize),sizeof(fileSize));
+    out.write(reinterpret_cast<const char*>(&numEntries),sizeof(numEntries));
+    out.write(reinterpret_cast<const char*>(records.data()),records.size());
+    if (!out) {
+      out.close();
+      std::remove(tmpName.c_str());
+      return false;
+    }
+  }
+  // rename so concurrent readers never see a partially written index
+  return std::rename(tmpName.c_str(),indexName.c_str())==0;
+}
@@ -0,0 +1,42 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+/**
+ * Position and header summary of one event in a raw data file. Stored in the index file
+ * field by field (EventIndex::entrySize bytes), not as the in-memory struct.
+ */
+struct EventIndexEntry {
+  uint64_t offset;
+  uint32_t size;
+  uint8_t  event_tag;
+  uint16_t trigger_bits;
+  uint64_t event_id;
+  uint64_t timestamp; // in us
+};
+
+/**
+ * Offset index of the events in a raw data file, so that selected events can be
+ * read without decoding everything in between. The index is cached next to the
+ * data file as <file>.idx and rebuilt when it does not match the data file.
+ */
+class EventIndex {
+public:
+  /// Loads the cached index of fileName, or builds (and tries to cache) it if missing or stale
+  static std::vector<EventIndexEntry> get(const std::string& fileName, bool& rebuilt);
+
+  /// Scans event headers from the start of the stream, skipping over the payloads
+  static std::vector<EventIndexEntry> build(std::istream& in);
+
+private:
+  static constexpr uint32_t version = 2;
+  static constexpr uint32_t entrySize = 8+4+1+2+8+8; // fields of EventIndexEntry without padding
+  static bool load(const std::string& indexName, uint64_t fileSize, std::vector<EventIndexEntry>& entries);
+  static bool save(const std::string& indexName, uint64_t fileSize, const std::vector<EventIndexEntry>& entries);
+};
@@ -20,6 +20,47 @@ EventPlaybackModule::EventPlaybackModule(const std::string& n):FaserProcess(n) {
 
   m_timeBetween = 1000000us/cfg.value("maxRate",10);
   m_repeats = cfg.value("repeats",1);
+
+  std::string replayMode = cfg.value("replayMode","rate");
+  if (replayMode=="rate") m_replayMode=RATE_REPLAY;
+  else if (replayMode=="timestamp") m_replayMode=TIMESTAMP_REPLAY;
+  else throw EventPlaybackException("Unknown replayMode '"+replayMode+"' - must be 'rate' or 'timestamp'");
+  m_speedFactor = cfg.value("speedFactor",1.0);
+  if (m_speedFactor<=0) throw EventPlaybackException("speedFactor must be positive");
+  m_maxLag = 1000us*cfg.value("maxLag_ms",0);
+  m_maxGap = 1000us*cfg.value("maxGap_ms",0);
+  m_readerThreads = cfg.value("readerThreads",2);
+  if (m_readerThreads<1) throw EventPlaybackException("readerThreads must be at least 1");
+  m_prefetchEvents = cfg.value("prefetchEvents",1000);
+  if (m_prefetchEvents<2) throw EventPlaybackException("prefetchEvents must be at least 2");
+
+  std::string playbackMode = cfg.value("playbackMode","event");
+  if (playbackMode=="event") m_playbackMode=EVENT_PLAYBACK;
+  else if (playbackMode=="fragment") m_playbackMode=FRAGMENT_PLAYBACK;
+  else throw EventPlaybackException("Unknown playbackMode '"+playbackMode+"' - must be 'event' or 'fragment'");
+  if (m_playbackMode==FRAGMENT_PLAYBACK) {
+    // fragments of the n-th listed source are sent on channel n
+    int channel=0;
+    for(auto& sourceID : cfg["fragmentIDs"])
+      m_sourceChannels[sourceID.get<uint32_t>()]=channel++;
+    if (m_sourceChannels.empty()) throw EventPlaybackException("fragmentIDs must be set for fragment playback");
+    m_channelDue.assign(channel,steady_clock::time_point());
+    m_fragmentSequence=0;
+  }
+  m_maxSkew = 1us*cfg.value("maxSkew_us",0);
+  m_fragmentLoss = cfg.value("fragmentLoss",0.0);
+  if (m_fragmentLoss<0 || m_fragmentLoss>1) throw EventPlaybackException("fragmentLoss must be between 0 and 1");
+  m_random.seed(cfg.value("randomSeed",std::random_device()()));
+
+  for(auto& tag : cfg.value("eventTags",nlohmann::json::array()))
+    m_selectTags.insert(tag.get<uint8_t>());
+  m_triggerMask = cfg.value("triggerMask",0);
+  for(auto& range : cfg.value("eventIDRanges",nlohmann::json::array()))
+    m_eventIDRanges.emplace_back(range.at(0).get<uint64_t>(),range.at(1).get<uint64_t>());
+  for(auto& window : cfg.value("timeWindows",nlohmann::json::array())) // in seconds since epoch
+    m_timeWindows.emplace_back(static_cast<uint64_t>(window.at(0).get<double>()*1e6),
+			       static_cast<uint64_t>(window.at(1).get<double>()*1e6));
+  m_filtered = !m_selectTags.empty() || m_triggerMask || !m_eventIDRanges.empty() || !m_timeWindows.empty();
   for( auto& fileName : cfg["fileList"]) 
     m_fileList.push_back(fileName.get<std::string>());
 }
@@ -39,6 +80,19 @@ void EventPlaybackModule::configure() {
   registerVariable(m_eventCounts[EventTags::CalibrationTag], "CalibrationRate", metrics::RATE);
   registerVariable(m_run_number, "RunNumber");
   registerVariable(m_run_start, "RunStart");
+  registerVariable(m_prefetched, "PrefetchedEvents");
+  registerVariable(m_underruns, "PrefetchUnderruns");
+  if (m_filtered) registerVariable(m_skippedEvents, "SkippedEvents");
+  if (m_playbackMode==FRAGMENT_PLAYBACK) {
+    registerVariable(m_fragmentsSent, "FragmentsSent");
+    registerVariable(m_fragmentsSent, "FragmentRate", metrics::RATE);
+    registerVariable(m_fragmentsLost, "FragmentsLost");
+    registerVariable(m_fragmentsUnmapped, "FragmentsUnmapped");
+  }
+  if (m_replayMode==TIMESTAMP_REPLAY) {
+    registerVariable(m_replayLag, "ReplayLag", metrics::AVERAGE);
+    registerVariable(m_replayResyncs, "ReplayResyncs");
+  }
 }
 
 void EventPlaybackModule::start(unsigned int run_num) {
@@ -46,6 +100,13 @@ void EventPlaybackModule::start(unsigned int run_num) {
   m_run_number = run_num; 
   m_run_start = std::time(nullptr);
   for(int ii=0;ii<MaxAnyTag;ii++) m_eventCounts[ii]=0;
+  m_timeBaseSet = false;
+  m_replayLag = 0;
+  m_replayResyncs = 0;
+  m_fragmentsSent = 0;
+  m_fragmentsLost = 0;
+  m_fragmentsUnmapped = 0;
+  m_skippedEvents = 0;
   m_status = STATUS_OK;
 }
 
@@ -54,9 +115,55 @@ void EventPlaybackModule::stop() {
 }
 
 
+/**
+ * Sleeps until the event recorded at 'timestamp' (in us) is due according to the
+ * recorded time base, scaled by the speed factor. Sends are scheduled against a fixed
+ * anchor rather than relative to the previous event, so sleep overshoot and send time
+ * do not accumulate and the replay catches up again after a stall.
+ * Returns false if the run was stopped while waiting.
+ */
+bool EventPlaybackModule::waitForSchedule(uint64_t timestamp) {
+  auto now=steady_clock::now();
+  if (m_timeBaseSet && timestamp+1000000<m_recordedLast) {
+    // small inversions come from the event builder completing events out of order,
+    // a large step back means we started over on a new file or repeat
+    DEBUG("Recorded time went backwards - re-anchoring time base");
+    m_timeBaseSet=false;
+  }
+  if (m_timeBaseSet && m_maxGap>0us && timestamp>m_recordedLast &&
+      microseconds(timestamp-m_recordedLast)>m_maxGap) {
+    // keep the schedule running, but skip the part of the gap beyond maxGap
+    m_recordedStart+=timestamp-m_recordedLast-m_maxGap.count();
+  }
+  if (!m_timeBaseSet) {
+    m_recordedStart=timestamp;
+    m_recordedLast=timestamp;
+    m_replayStart=now;
+    m_timeBaseSet=true;
+  }
+  m_recordedLast=std::max(m_recordedLast,timestamp);
+
+  int64_t offset=static_cast<int64_t>(timestamp)-static_cast<int64_t>(m_recordedStart);
+  auto scheduled=m_replayStart+microseconds(static_cast<int64_t>(offset/m_speedFactor));
+  while (scheduled>now) { // sleep in slices to stay responsive to stop during long gaps
+    if (!m_run) return false;
+    sleepUntil(std::min(scheduled,now+100ms));
+    now=steady_clock::now();
+  }
+  auto lag=duration_cast<microseconds>(now-scheduled);
+  m_replayLag=lag.count()/1000.;
+  if (m_maxLag>0us && lag>m_maxLag) {
+    WARNING("Replay is "<<lag.count()/1000<<" ms behind schedule - re-anchoring time base");
+    m_recordedStart=timestamp;
+    m_replayStart=now;
+    m_replayResyncs++;
+  }
+  return true;
+}
+
 bool EventPlaybackModule::sendEvent(uint8_t event_tag,EventFull *event) {
   int channel=event_tag; 
-  INFO("Sending event "<<event->event_id()<<" - "<<event->size()<<" bytes on channel "<<channel);
+  DEBUG("Sending event "<<event->event_id()<<" - "<<event->size()<<" bytes on channel "<<channel);
   auto *bytestream=event->raw();
   DataFragment<daqling::utilities::Binary> binData(bytestream->data(),bytestream->size());
   DataFragment<daqling::utilities::Binary> binData2(bytestream->data(),bytestream->size());
@@ -67,51 +174,208 @@ bool EventPlaybackModule::sendEvent(uint8_t event_tag,EventFull *event) {
   return true;
 }
 
+/**
+ * Splits the event back into its fragments and queues each of them for its source
+ * channel, randomly dropped with probability m_fragmentLoss and delayed by up to
+ * m_maxSkew to emulate sources reporting out of step with each other.
+ */
+void EventPlaybackModule::sendFragments(EventFull *event) {
+  std::uniform_real_distribution<double> uniform(0.,1.);
+  auto now=steady_clock::now();
+  for(auto sourceID : event->getFragmentIDs()) {
+    auto it=m_sourceChannels.find(sourceID);
+    if (it==m_sourceChannels.end()) {
+      m_fragmentsUnmapped++;
+      continue;
+    }
+    if (m_fragmentLoss>0 && uniform(m_random)<m_fragmentLoss) {
+      DEBUG("Dropping fragment from source 0x"<<std::hex<<sourceID<<std::dec<<" of event "<<event->event_id());
+      m_fragmentsLost++;
+      continue;
+    }
+    // skewed between sources, but never ahead of an earlier fragment of the same source
+    auto due=std::max(now+microseconds(static_cast<int64_t>(uniform(m_random)*m_maxSkew.count())),m_channelDue[it->second]);
+    m_channelDue[it->second]=due;
+    m_delayedFragments.push_back(DelayedFragment{due,m_fragmentSequence++,it->second,
+	  std::unique_ptr<const byteVector>(event->find_fragment(sourceID)->raw())});
+    std::push_heap(m_delayedFragments.begin(),m_delayedFragments.end());
+  }
+  flushFragments(false);
+}
+
+/**
+ * Sends the held back fragments that are due, or all of them if 'all' is set.
+ */
+void EventPlaybackModule::flushFragments(bool all) {
+  auto now=steady_clock::now();
+  while (!m_delayedFragments.empty() && (all || m_delayedFragments.front().due<=now)) {
+    std::pop_heap(m_delayedFragments.begin(),m_delayedFragments.end());
+    auto& fragment=m_delayedFragments.back();
+    DataFragment<daqling::utilities::Binary> binData(fragment.data->data(),fragment.data->size());
+    m_connections.send(fragment.channel,binData);
+    m_fragmentsSent++;
+    m_delayedFragments.pop_back();
+  }
+}
+
+/**
+ * Sleeps until 'until', waking up in between to send delayed fragments when they are due.
+ */
+void EventPlaybackModule::sleepUntil(steady_clock::time_point until) {
+  flushFragments(false);
+  while (!m_delayedFragments.empty() && m_delayedFragments.front().due<until) {
+    std::this_thread::sleep_until(m_delayedFragments.front().due);
+    flushFragments(false);
+  }
+  std::this_thread::sleep_until(until);
+}
+
+bool EventPlaybackModule::selected(const EventIndexEntry& entry) const {
+  if (!m_selectTags.empty() && !m_selectTags.count(entry.event_tag)) return false;
+  if (m_triggerMask && !(entry.trigger_bits&m_triggerMask)) return false;
+  auto inRange=[](const std::vector<std::pair<uint64_t,uint64_t>>& ranges,uint64_t value) {
+    if (ranges.empty()) return true;
+    for(auto& range : ranges)
+      if (value>=range.first && value<=range.second) return true;
+    return false;
+  };
+  return inRange(m_eventIDRanges,entry.event_id) && inRange(m_timeWindows,entry.timestamp);
+}
+
+/**
+ * Reads every m_readerThreads-th entry of the play list, starting at readerId, and
+ * queues the decoded events followed by an end-of-file marker. The queue bounds how
+ * far ahead of the sender each reader gets. With a selection configured, only the
+ * selected events are read, seeking to them using the file index.
+ */
+void EventPlaybackModule::reader(unsigned int readerId, EventQueue &queue) {
+  const size_t numFiles=m_fileList.size();
+  const size_t numEntries=m_repeats*numFiles; // 0 for infinite repeats
+
+  auto push=[&](PrefetchItem&& item) {
+    while (!queue.write(std::move(item))) { // item is only moved from on success
+      if (m_stopReaders) return false;
+      std::this_thread::sleep_for(1ms);
+    }
+    return true;
+  };
+
+  for(size_t entry=readerId; !m_stopReaders && (numEntries==0 || entry<numEntries); entry+=m_readerThreads) {
+    const std::string& fileName=m_fileList[entry%numFiles];
+    std::ifstream infh(fileName,std::ios::binary);
+    if (!infh.is_open()) {
+      push(PrefetchItem{PrefetchItem::OPEN_FAILED,nullptr});
+      return;
+    }
+    DEBUG("Reader "<<readerId<<" prefetching events from "<<fileName);
+    if (m_filtered) {
+      bool rebuilt;
+      auto index=EventIndex::get(fileName,rebuilt);
+      if (rebuilt) INFO("Built index of "<<index.size()<<" events for "<<fileName);
+      for(auto& entry : index) {
+	if (!selected(entry)) {
+	  m_skippedEvents++;
+	  continue;
+	}
+	try {
+	  infh.seekg(entry.offset);
+	  if (!push(PrefetchItem{PrefetchItem::EVENT,std::make_unique<EventFull>(infh)})) return;
+	} catch (EFormatException &e) {
+	  INFO("Got exception while reading "<<fileName<<":"<<e);
+	  break;
+	}
+      }
+    }
+    while (!m_filtered && infh.good() && infh.peek()!=EOF) {
+      try {
+	if (!push(PrefetchItem{PrefetchItem::EVENT,std::make_unique<EventFull>(infh)})) return;
+      } catch (EFormatException &e) {
+	INFO("Got exception while reading "<<fileName<<":"<<e);
+	break;
+      }
+    }
+    if (!push(PrefetchItem{PrefetchItem::END_OF_FILE,nullptr})) return;
+  }
+}
 
 void EventPlaybackModule::runner() noexcept {
   INFO("Running...");
 
-  DataFragment<daqling::utilities::Binary>  blob;
-  auto last=system_clock::now();
-  std::ifstream infh;
-  unsigned int runCount=0;
-  auto curFileName=m_fileList.end();
+  if (m_fileList.empty()) {
+    ERROR("No input files configured");
+    return;
+  }
+
+  m_stopReaders=false;
+  for(unsigned int ii=0;ii<m_readerThreads;ii++) {
+    m_queues.push_back(std::make_unique<EventQueue>(m_prefetchEvents));
+  }
+  for(unsigned int ii=0;ii<m_readerThreads;ii++) {
+    m_readers.emplace_back(&EventPlaybackModule::reader,this,ii,std::ref(*m_queues[ii]));
+  }
+
+  auto last=steady_clock::now();
+  const size_t numFiles=m_fileList.size();
+  size_t entry=0;
+  size_t passEvents=0; // events sent in the current pass over the file list
   bool newFile=true;
+  bool starved=false;
   while (m_run) { 
-    auto now=system_clock::now();
-    microseconds delta=m_timeBetween-duration_cast<microseconds>(now-last);
-    if (delta>0us) std::this_thread::sleep_for(delta);
-    last=system_clock::now();
+    if (m_repeats!=0 && entry>=m_repeats*numFiles) break;
+    EventQueue& queue=*m_queues[entry%m_readerThreads];
+    const std::string& fileName=m_fileList[entry%numFiles];
     if (newFile) {
-      if (curFileName==m_fileList.end()) {
-	runCount++;
-	if (m_repeats!=0 && runCount>m_repeats) break;
-	curFileName=m_fileList.begin();
-      }
-      infh.close();
-      infh.open(*curFileName,std::ios::binary);
-      if (!infh.is_open()) {
-	ERROR("Failed to open file "<<*curFileName);
-	break;
-      }
-      INFO("Sending events from "<<*curFileName);
+      INFO("Sending events from "<<fileName);
       newFile=false;
     }
-    
-    if (infh.good() && infh.peek()!=EOF) {
-      try {
-	EventFull event(infh);
-	uint8_t tag=event.event_tag();
-	m_eventCounts[tag]++;
-	sendEvent(tag,&event);
-      } catch (EFormatException &e) {
-	INFO("Got exception while reading "<<(*curFileName)<<":"<<e);
-	newFile=true;
-      }
-    } else {
+
+    PrefetchItem* item=queue.frontPtr();
+    if (!item) {
+      if (!starved) m_underruns++;
+      starved=true;
+      std::this_thread::sleep_for(100us);
+      continue;
+    }
+    starved=false;
+    if (item->type==PrefetchItem::OPEN_FAILED) {
+      ERROR("Failed to open file "<<fileName);
+      break;
+    }
+    if (item->type==PrefetchItem::END_OF_FILE) {
+      queue.popFront();
+      entry++;
       newFile=true;
+      if (entry%numFiles==0) {
+	if (m_filtered && passEvents==0) { // would repeat forever without sending anything
+	  ERROR("No events selected in any of the input files");
+	  break;
+	}
+	passEvents=0;
+      }
+      continue;
     }
-    if (newFile) curFileName++;
+    std::unique_ptr<EventFull> event=std::move(item->event);
+    queue.popFront();
+
+    size_t prefetched=0;
+    for(auto& q : m_queues) prefetched+=q->sizeGuess();
+    m_prefetched=prefetched;
+
+    if (m_replayMode==RATE_REPLAY) {
+      sleepUntil(last+m_timeBetween);
+      last=steady_clock::now();
+    } else if (!waitForSchedule(event->timestamp())) break;
+    uint8_t tag=event->event_tag();
+    m_eventCounts[tag]++;
+    passEvents++;
+    if (m_playbackMode==FRAGMENT_PLAYBACK) sendFragments(event.get());
+    else sendEvent(tag,event.get());
   }
+  flushFragments(true);
+
+  m_stopReaders=true;
+  for(auto& reader : m_readers) reader.join();
+  m_readers.clear();
+  m_queues.clear();
   INFO("Runner stopped");
 }
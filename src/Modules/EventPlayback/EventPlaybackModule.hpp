@@ -6,9 +6,14 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
+#include <thread>
+#include <random>
 
 #include "Commons/FaserProcess.hpp"
+#include "folly/ProducerConsumerQueue.h"
 #include "EventFormats/DAQFormats.hpp"
+#include "EventIndex.hpp"
 #include "Exceptions/Exceptions.hpp"
 
 using namespace DAQFormats;
@@ -28,13 +33,83 @@ class EventPlaybackModule : public FaserProcess {
   void runner() noexcept;
   bool sendEvent(uint8_t event_tag,EventFull *event);
   void addFragment(EventFragment *fragment);
+  void sendFragments(EventFull *event);
 
 private:
+  enum ReplayMode { RATE_REPLAY=0, TIMESTAMP_REPLAY };
+  enum PlaybackMode { EVENT_PLAYBACK=0, FRAGMENT_PLAYBACK };
+
+  // fragment playback: fragments held back to emulate skew between sources
+  struct DelayedFragment {
+    steady_clock::time_point due;
+    uint64_t sequence; // order of equally due fragments
+    int channel;
+    std::unique_ptr<const byteVector> data;
+    bool operator<(const DelayedFragment& other) const { // earliest on top of heap
+      return due!=other.due ? due>other.due : sequence>other.sequence;
+    }
+  };
+
+  // events are read and decoded ahead of time by reader threads. Entry k of the
+  // play list (file list times repeats) is read by reader k%m_readerThreads.
+  struct PrefetchItem {
+    enum Type { EVENT=0, END_OF_FILE, OPEN_FAILED };
+    Type type;
+    std::unique_ptr<EventFull> event;
+  };
+  using EventQueue = folly::ProducerConsumerQueue<PrefetchItem>;
+
+  bool waitForSchedule(uint64_t timestamp);
+  void sleepUntil(steady_clock::time_point until);
+  void flushFragments(bool all);
+  void reader(unsigned int readerId, EventQueue &queue);
+  bool selected(const EventIndexEntry& entry) const;
+
+  ReplayMode m_replayMode;
+  PlaybackMode m_playbackMode;
   microseconds m_timeBetween;
   unsigned int m_repeats;
+
+  // timestamp replay: recorded time base (in us) and wall clock anchor it is mapped to
+  double m_speedFactor;
+  microseconds m_maxLag;  // re-anchor time base when lagging more than this (0: never)
+  microseconds m_maxGap;  // compress recorded gaps longer than this (0: never)
+  bool m_timeBaseSet;
+  uint64_t m_recordedStart;
+  uint64_t m_recordedLast;
+  steady_clock::time_point m_replayStart;
+  std::atomic<float> m_replayLag; // in ms
+  std::atomic<int> m_replayResyncs;
   std::atomic<int> m_run_number;
   std::atomic<int> m_run_start;
 
+  std::map<uint32_t,int> m_sourceChannels; // fragment source ID -> sender channel
+  microseconds m_maxSkew;
+  double m_fragmentLoss;
+  std::mt19937 m_random;
+  std::vector<DelayedFragment> m_delayedFragments; // heap ordered on due time
+  std::vector<steady_clock::time_point> m_channelDue; // latest due time per channel, keeps its fragments in order
+  uint64_t m_fragmentSequence;
+  std::atomic<int> m_fragmentsSent;
+  std::atomic<int> m_fragmentsLost;
+  std::atomic<int> m_fragmentsUnmapped;
+
+  // filtered playback: only events matching all configured criteria are read, using the file index
+  bool m_filtered;
+  std::set<uint8_t> m_selectTags;
+  uint16_t m_triggerMask; // any of these bits set (0: no requirement)
+  std::vector<std::pair<uint64_t,uint64_t>> m_eventIDRanges; // inclusive
+  std::vector<std::pair<uint64_t,uint64_t>> m_timeWindows;   // in us, inclusive
+  std::atomic<int> m_skippedEvents;
+
+  unsigned int m_readerThreads;
+  unsigned int m_prefetchEvents; // per reader
+  std::atomic<bool> m_stopReaders;
+  std::vector<std::unique_ptr<EventQueue>> m_queues;
+  std::vector<std::thread> m_readers;
+  std::atomic<size_t> m_prefetched;
+  std::atomic<int> m_underruns;
+
   std::atomic<int> m_eventCounts[MaxAnyTag];
   
   std::vector<std::string> m_fileList;
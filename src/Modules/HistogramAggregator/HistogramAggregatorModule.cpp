@@ -0,0 +1,158 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+
+#include <cmath>
+#include <string>
+
+#include "HistogramAggregatorModule.hpp"
+#include "Utils/Ers.hpp"
+#include "Utils/HistogramMessage.hpp"
+
+using namespace std::chrono;
+
+HistogramAggregatorModule::HistogramAggregatorModule(const std::string& n):FaserProcess(n) {
+  auto cfg = getModuleSettings();
+  m_inputURI = cfg.value("inputURI", "");
+  if (m_inputURI.empty()) throw HistogramAggregatorException("inputURI must be set");
+  for(auto& source : cfg.value("sources", nlohmann::json::array()))
+    m_sources.insert(source.get<std::string>());
+  m_publishInterval = seconds(cfg.value("publishInterval", 5));
+  if (m_publishInterval<1s) throw HistogramAggregatorException("publishInterval must be at least 1 s");
+  m_sourceTimeout = seconds(cfg.value("sourceTimeout", 0));
+  m_forwardInputs = cfg.value("forwardInputs", true);
+  std::string format = cfg.value("histogramFormat", "binary");
+  if (format!="json" && format!="binary") throw HistogramAggregatorException("Unknown histogramFormat '"+format+"' - must be 'json' or 'binary'");
+  m_binaryFormat = format=="binary";
+}
+
+HistogramAggregatorModule::~HistogramAggregatorModule() { }
+
+void HistogramAggregatorModule::configure() {
+  FaserProcess::configure();
+  std::string statsURI = m_config.getMetricsSettings().value("stats_uri", "");
+  if (statsURI.empty()) throw HistogramAggregatorException("No stats_uri given to publish the merged histograms on");
+  if (statsURI==m_inputURI) throw HistogramAggregatorException("inputURI must differ from stats_uri");
+
+  m_context = std::make_unique<zmq::context_t>(1);
+  m_input = std::make_unique<zmq::socket_t>(*m_context, ZMQ_SUB);
+  m_input->setsockopt(ZMQ_RCVTIMEO, 100); // ms, to check for publication and end of run
+  m_input->setsockopt(ZMQ_SUBSCRIBE, "", 0);
+  m_input->bind(m_inputURI);
+  m_output = std::make_unique<zmq::socket_t>(*m_context, ZMQ_PUB);
+  m_output->connect(statsURI);
+  std::string archiveURI = m_config.getMetricsSettings().value("archive_uri", "");
+  if (!archiveURI.empty()) m_output->connect(archiveURI); // sums are archived as well
+  INFO("Aggregating histograms received on "<<m_inputURI<<", publishing on "<<statsURI);
+
+  registerVariable(m_received, "histograms_received", metrics::RATE);
+  registerVariable(m_rejected, "histograms_rejected", metrics::RATE);
+  registerVariable(m_published, "histograms_published", metrics::RATE);
+  registerVariable(m_activeSources, "active_sources", metrics::LAST_VALUE);
+}
+
+void HistogramAggregatorModule::start(unsigned run_num) {
+  FaserProcess::start(run_num);
+  // monitors start over with empty histograms in every run
+  m_merger.clear();
+  m_unmergeable.clear();
+  m_lastSeen.clear();
+  m_lastPublish = steady_clock::now();
+  m_status = STATUS_OK;
+}
+
+void HistogramAggregatorModule::stop() {
+  FaserProcess::stop();
+  INFO("Aggregated "<<m_merger.size()<<" histograms from "<<m_lastSeen.size()<<" sources");
+}
+
+void HistogramAggregatorModule::runner() noexcept {
+  INFO("Running...");
+  while (m_run) {
+    zmq::message_t message;
+    if (m_input->recv(&message)) receive(message);
+    if (steady_clock::now()-m_lastPublish>=m_publishInterval) {
+      dropSilentSources();
+      publish();
+      m_lastPublish = steady_clock::now();
+    }
+  }
+  publish(); // final contents of the run
+  INFO("Runner stopped");
+}
+
+void HistogramAggregatorModule::receive(zmq::message_t& message) {
+  const char* data = static_cast<const char*>(message.data());
+  HistogramMessage hist;
+  bool histogram = hist.split(data, message.size());
+  auto seen = m_lastSeen.find(hist.source);
+  if (seen!=m_lastSeen.end()) seen->second = steady_clock::now();
+
+  if (!histogram || (!m_sources.empty() && !m_sources.count(hist.source))) {
+    send(std::string(data, message.size()));
+    return;
+  }
+  if (m_forwardInputs) send(std::string(data, message.size()));
+  m_received++;
+
+  json schema;
+  std::vector<float> values;
+  if (!hist.decode(schema, values)) {
+    m_rejected++;
+    WARNING("Failed to decode histogram from "<<hist.source);
+    return;
+  }
+  if (seen==m_lastSeen.end()) {
+    INFO("Source "<<hist.source<<" joined");
+    m_lastSeen[hist.source] = steady_clock::now();
+    m_activeSources = m_lastSeen.size();
+  }
+  if (!HistogramMerger::mergeable(schema)) {
+    std::string name = schema.value("name", "");
+    if (m_unmergeable.insert(name).second) WARNING("Not merging "<<name<<": trends cannot be summed");
+    return;
+  }
+  std::string error = m_merger.add(hist.source, std::move(schema), std::move(values));
+  if (!error.empty()) {
+    m_rejected++;
+    DEBUG("Not merged: "<<error);
+  }
+}
+
+void HistogramAggregatorModule::dropSilentSources() {
+  if (m_sourceTimeout==0s) return;
+  auto now = steady_clock::now();
+  for (auto source = m_lastSeen.begin(); source!=m_lastSeen.end();) {
+    if (now-source->second>m_sourceTimeout) {
+      INFO("Source "<<source->first<<" silent for more than "<<m_sourceTimeout.count()<<" s - dropping its histograms");
+      m_merger.remove(source->first);
+      source = m_lastSeen.erase(source);
+    }
+    else ++source;
+  }
+  m_activeSources = m_lastSeen.size();
+}
+
+void HistogramAggregatorModule::publish() {
+  json schema;
+  std::vector<float> values;
+  for (auto& name : m_merger.take_changed()) {
+    if (!m_merger.merge(name, schema, values)) continue;
+    std::string msg = getName()+(m_binaryFormat ? "-hb_" : "-h_")+name+": ";
+    if (m_binaryFormat) msg += HistBase::encode_binary(schema, values);
+    else {
+      std::string key = schema["type"].get<std::string>().compare(0, 2, "2d")==0 ? "zvalues" : "yvalues";
+      if (std::all_of(values.begin(), values.end(), [](float v) { return v==std::floor(v); }))
+        schema[key] = std::vector<int64_t>(values.begin(), values.end());
+      else schema[key] = values;
+      msg += schema.dump();
+    }
+    send(msg);
+    m_published++;
+  }
+}
+
+void HistogramAggregatorModule::send(const std::string& msg) {
+  zmq::message_t message(msg.data(), msg.size());
+  if (!m_output->send(message)) WARNING("Failed to send message of "<<msg.size()<<" bytes");
+}
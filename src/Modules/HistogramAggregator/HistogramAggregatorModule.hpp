@@ -0,0 +1,61 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+
+#include "Commons/FaserProcess.hpp"
+#include "Exceptions/Exceptions.hpp"
+#include "zmq.hpp"
+#include "HistogramMerger.hpp"
+
+class HistogramAggregatorException : public Exceptions::BaseException { using Exceptions::BaseException::BaseException; };
+
+/**
+ * Receives the stats publications of several monitors, sums their histograms bin-wise
+ * by name and publishes the sums as its own histograms. Monitors point their stats_uri
+ * to inputURI; their metrics (and, unless disabled, their own histograms) are passed on
+ * unchanged to the stats connection of the aggregator.
+ */
+class HistogramAggregatorModule : public FaserProcess {
+ public:
+  HistogramAggregatorModule(const std::string& n);
+  ~HistogramAggregatorModule();
+
+  void configure();
+  void start(unsigned);
+  void stop();
+
+  void runner() noexcept;
+
+private:
+  void receive(zmq::message_t& message);
+  void publish();
+  void send(const std::string& msg);
+  void dropSilentSources();
+
+  std::string m_inputURI;
+  std::set<std::string> m_sources; // monitors to aggregate (empty: all)
+  std::chrono::seconds m_publishInterval;
+  std::chrono::seconds m_sourceTimeout; // 0: keep contributions of silent sources
+  bool m_forwardInputs;
+  bool m_binaryFormat;
+
+  std::unique_ptr<zmq::context_t> m_context;
+  std::unique_ptr<zmq::socket_t> m_input;
+  std::unique_ptr<zmq::socket_t> m_output;
+
+  HistogramMerger m_merger;
+  std::set<std::string> m_unmergeable; // histograms not merged, warned about once
+  std::map<std::string,std::chrono::steady_clock::time_point> m_lastSeen; // per histogram source
+  std::chrono::steady_clock::time_point m_lastPublish;
+
+  std::atomic<int> m_received;
+  std::atomic<int> m_rejected;
+  std::atomic<int> m_published;
+  std::atomic<int> m_activeSources;
+};
@@ -0,0 +1,158 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#include <cmath>
+
+#include "HistogramMerger.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+  bool extendable(const json& schema) {
+    std::string type = schema.value("type", "");
+    return type.size()>4 && type.compare(type.size()-4, 4, "_ext")==0;
+  }
+
+  double bin_width(const json& schema) {
+    return (schema["xmax"].get<double>()-schema["xmin"].get<double>())/schema["xbins"].get<double>();
+  }
+
+  const char* values_key(const json& schema) {
+    return schema.value("type", "").compare(0, 2, "2d")==0 ? "zvalues" : "yvalues";
+  }
+}
+
+bool HistogramMerger::compatible(const json& a, const json& b) {
+  if (a.value("type", "")!=b.value("type", "")) return false;
+  if (a.contains("normalisation")!=b.contains("normalisation")) return false;
+  if (extendable(a)) return std::fabs(bin_width(a)-bin_width(b))<=1e-6*std::fabs(bin_width(a));
+  for (auto key : {"xbins", "xmin", "xmax", "ybins", "ymin", "ymax", "categories"})
+    if (a.value(key, json())!=b.value(key, json())) return false;
+  return true;
+}
+
+std::string HistogramMerger::add(const std::string& source, json schema, std::vector<float> values) {
+  std::string name = schema.value("name", "");
+  if (name.empty()) return "histogram without name";
+  if (!mergeable(schema)) return name+" is a trend, trends are not merged";
+  if (schema.value("delta", false)) {
+    auto hist = m_hists.find(name);
+    auto current = hist!=m_hists.end() ? hist->second.find(source) : std::map<std::string,Contribution>::iterator();
+    if (hist==m_hists.end() || current==hist->second.end()) return "delta for "+name+" before its first full publication";
+    if (values.empty() && schema.contains(values_key(schema))) values = schema[values_key(schema)].get<std::vector<float>>();
+    auto& bins = schema["bins"];
+    if (bins.size()!=values.size()) return "delta for "+name+" with "+std::to_string(bins.size())+" bins but "+std::to_string(values.size())+" values";
+    auto& contents = current->second.values;
+    if (schema.contains("normalisation")) current->second.schema["normalisation"] = schema["normalisation"];
+    for (size_t ii=0; ii<values.size(); ii++) {
+      unsigned bin = bins[ii];
+      if (bin>=contents.size()) return "delta for "+name+" beyond its last bin";
+      contents[bin] = values[ii];
+    }
+    m_changed.insert(name);
+    return "";
+  }
+
+  const char* key = values_key(schema);
+  if (values.empty() && schema.contains(key)) values = schema[key].get<std::vector<float>>();
+  schema.erase(key);
+  auto& sources = m_hists[name];
+  for (auto& other : sources) {
+    if (other.first==source) continue; // a source may change its own axes, e.g. when they grow
+    if (!compatible(other.second.schema, schema) || (!extendable(schema) && other.second.values.size()!=values.size()))
+      return name+" from "+source+" does not match the axes published by "+other.first;
+    break;
+  }
+  sources[source] = Contribution{std::move(schema), std::move(values)};
+  m_changed.insert(name);
+  return "";
+}
+
+void HistogramMerger::remove(const std::string& source) {
+  for (auto hist = m_hists.begin(); hist!=m_hists.end();) {
+    if (hist->second.erase(source)) m_changed.insert(hist->first);
+    if (hist->second.empty()) hist = m_hists.erase(hist);
+    else ++hist;
+  }
+}
+
+bool HistogramMerger::merge(const std::string& name, json& schema, std::vector<float>& values) const {
+  auto hist = m_hists.find(name);
+  if (hist==m_hists.end() || hist->second.empty()) return false;
+  auto& sources = hist->second;
+  schema = sources.begin()->second.schema;
+  schema["sources"] = sources.size();
+  values.clear();
+
+  if (schema.value("type", "")=="profile") return merge_profile(sources, schema, values);
+
+  // normalised contents are summed as counts, i.e. times their normalisation, and renormalised
+  bool normalised = schema.contains("normalisation");
+  double normalisation = 0;
+  auto counts = [normalised](const Contribution& source) { return normalised ? source.schema.value("normalisation", 1.0) : 1.0; };
+  auto renormalise = [&]() {
+    if (!normalised) return;
+    for (auto& value : values) value /= normalisation>0 ? normalisation : 1;
+    schema["normalisation"] = normalisation;
+  };
+
+  if (!extendable(schema)) {
+    values.resize(sources.begin()->second.values.size());
+    for (auto& source : sources) {
+      double scale = counts(source.second);
+      normalisation += scale;
+      for (size_t ii=0; ii<values.size(); ii++) values[ii] += source.second.values[ii]*scale;
+    }
+    renormalise();
+    return true;
+  }
+
+  // union of the ranges, contributions shifted by whole bins
+  double width = bin_width(schema);
+  double xmin = schema["xmin"], xmax = schema["xmax"];
+  for (auto& source : sources) {
+    xmin = std::min(xmin, source.second.schema["xmin"].get<double>());
+    xmax = std::max(xmax, source.second.schema["xmax"].get<double>());
+  }
+  size_t nbins = std::lround((xmax-xmin)/width);
+  values.resize(nbins);
+  for (auto& source : sources) {
+    long offset = std::lround((source.second.schema["xmin"].get<double>()-xmin)/width);
+    auto& contents = source.second.values;
+    double scale = counts(source.second);
+    normalisation += scale;
+    for (size_t ii=0; ii<contents.size() && offset+ii<nbins; ii++) values[offset+ii] += contents[ii]*scale;
+  }
+  renormalise();
+  schema["xbins"] = nbins;
+  schema["xmin"] = xmin;
+  schema["xmax"] = xmin+nbins*width;
+  return true;
+}
+
+// means weighted by the entries of each source, spreads from the combined moments
+bool HistogramMerger::merge_profile(const std::map<std::string,Contribution>& sources, json& schema, std::vector<float>& values) {
+  size_t nbins = sources.begin()->second.values.size();
+  std::vector<double> entries(nbins), means(nbins), m2(nbins);
+  for (auto& source : sources) {
+    auto& contents = source.second.values;
+    auto source_entries = source.second.schema.value("entries", std::vector<double>());
+    auto source_spread = source.second.schema.value("spread", std::vector<double>());
+    if (source_entries.size()!=nbins || source_spread.size()!=nbins) continue;
+    for (size_t ii=0; ii<nbins; ii++) {
+      double n = source_entries[ii];
+      if (n==0) continue;
+      double total = entries[ii]+n;
+      double delta = contents[ii]-means[ii];
+      means[ii] += delta*n/total;
+      m2[ii] += n*source_spread[ii]*source_spread[ii]+delta*delta*entries[ii]*n/total;
+      entries[ii] = total;
+    }
+  }
+  std::vector<float> spread(nbins);
+  for (size_t ii=0; ii<nbins; ii++) spread[ii] = entries[ii]>0 ? std::sqrt(m2[ii]/entries[ii]) : 0;
+  values.assign(means.begin(), means.end());
+  schema["entries"] = entries;
+  schema["spread"] = spread;
+  return true;
+}
@@ -0,0 +1,58 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Bin-wise sum of the histograms with the same name published by several sources
+ * (for profiles: the combined mean and spread per bin, for normalised histograms: the sum
+ * renormalised by the summed normalisation counts). Trends are not merged.
+ * The latest contents of every source are kept (deltas are applied to them), so a
+ * source publishing again replaces rather than adds to its previous contribution.
+ * Fixed axes must match exactly; extendable axes must have the same bin width and
+ * are merged over the union of their ranges.
+ */
+class HistogramMerger {
+public:
+  /// Takes a full or delta publication (schema as in the JSON format, without the bin
+  /// contents), returns an empty string or why it cannot be merged
+  std::string add(const std::string& source, nlohmann::json schema, std::vector<float> values);
+
+  /// Drops the contributions of a source, e.g. when it left the run
+  void remove(const std::string& source);
+  void clear() { m_hists.clear(); m_changed.clear(); }
+
+  /// Names of the histograms changed since they were last merged
+  std::set<std::string> take_changed() {
+    std::set<std::string> changed;
+    changed.swap(m_changed);
+    return changed;
+  }
+
+  /// False for histograms that cannot be summed: trends, whose points are means per source
+  static bool mergeable(const nlohmann::json& schema) { return schema.value("type", "")!="trend"; }
+
+  /// Sums the contributions to a histogram into values, with the merged axes and the
+  /// number of sources ("sources") in schema. Returns false if nobody publishes it any more.
+  bool merge(const std::string& name, nlohmann::json& schema, std::vector<float>& values) const;
+
+  size_t size() const { return m_hists.size(); }
+
+private:
+  struct Contribution {
+    nlohmann::json schema;
+    std::vector<float> values;
+  };
+  static bool compatible(const nlohmann::json& a, const nlohmann::json& b);
+  static bool merge_profile(const std::map<std::string,Contribution>& sources, nlohmann::json& schema, std::vector<float>& values);
+
+  std::map<std::string,std::map<std::string,Contribution>> m_hists; // name -> source -> contents
+  std::set<std::string> m_changed;
+};
@@ -0,0 +1,56 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "HistogramArchive.hpp"
+
+HistogramArchive::HistogramArchive(const std::string& fileName) : m_fileName(fileName) {
+  m_file.open(fileName, std::ios::binary|std::ios::app|std::ios::ate);
+  m_index.open(fileName+".idx", std::ios::app);
+  if (!m_file.is_open() || !m_index.is_open()) throw std::runtime_error("Failed to open histogram archive "+fileName);
+  m_offset = m_file.tellp();
+  m_index << std::fixed << std::setprecision(3);
+}
+
+size_t HistogramArchive::write(const Record& record) {
+  nlohmann::json hist = record.schema;
+  std::string name = hist.value("name", "");
+  const char* key = hist.value("type", "").compare(0, 2, "2d")==0 ? "zvalues" : "yvalues";
+  if (std::all_of(record.values.begin(), record.values.end(), [](float v) { return v==std::floor(v); }))
+    hist[key] = std::vector<int64_t>(record.values.begin(), record.values.end());
+  else hist[key] = record.values;
+  hist["source"] = record.source;
+  hist["ts"] = record.timestamp;
+  std::string line = hist.dump()+"\n";
+
+  // one gzip member per record (window bits 15, +16 for the gzip header)
+  z_stream stream{};
+  if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY)!=Z_OK)
+    throw std::runtime_error("Failed to initialise compression");
+  m_buffer.resize(deflateBound(&stream, line.size()));
+  stream.next_in = reinterpret_cast<Bytef*>(&line[0]);
+  stream.avail_in = line.size();
+  stream.next_out = reinterpret_cast<Bytef*>(&m_buffer[0]);
+  stream.avail_out = m_buffer.size();
+  int rc = deflate(&stream, Z_FINISH);
+  size_t size = stream.total_out;
+  deflateEnd(&stream);
+  if (rc!=Z_STREAM_END) throw std::runtime_error("Failed to compress histogram "+name);
+
+  m_file.write(m_buffer.data(), size);
+  if (!m_file) throw std::runtime_error("Failed to write to histogram archive "+m_fileName);
+  m_index << m_offset << " " << size << " " << record.timestamp << " " << record.source << " " << name << "\n";
+  m_offset += size;
+  return size;
+}
+
+void HistogramArchive::flush() {
+  m_file.flush();
+  m_index.flush();
+}
@@ -0,0 +1,45 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * Histogram archive file of a run, written incrementally. Every record is a separate gzip
+ * member holding one line of JSON: the histogram as published, plus "source" and "ts", so
+ * the whole file reads as gzipped JSON lines. The index next to it (<file>.idx) has a line
+ * "offset size ts source name" per record, to read single histograms without decompressing
+ * the rest (see scripts/readHistArchive.py).
+ */
+class HistogramArchive {
+public:
+  struct Record {
+    std::string source;
+    nlohmann::json schema; // without bin contents
+    std::vector<float> values;
+    double timestamp;      // in seconds since epoch
+  };
+
+  /// Opens fileName for appending, throws std::runtime_error if it cannot be opened
+  HistogramArchive(const std::string& fileName);
+
+  /// Appends a record, returns its compressed size
+  size_t write(const Record& record);
+  void flush();
+
+  const std::string& fileName() const { return m_fileName; }
+  uint64_t bytes() const { return m_offset; }
+
+private:
+  std::string m_fileName;
+  std::ofstream m_file;
+  std::ofstream m_index;
+  uint64_t m_offset;
+  std::string m_buffer;
+};
@@ -4,50 +4,49 @@
 
 #include "HistogramArchiverModule.hpp"
 #include "Utils/Ers.hpp"
+#include "Utils/HistogramMessage.hpp"
 
 #include <cstdlib>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <stdexcept>
+#include <sys/stat.h>
 
 
-HistogramArchiverModule::HistogramArchiverModule(const std::string& n):FaserProcess(n) { 
-  ERS_INFO(""); 
+HistogramArchiverModule::HistogramArchiverModule(const std::string& n):FaserProcess(n) {
+  ERS_INFO("");
   auto cfg=getModuleSettings();
   m_filename_pattern=cfg["filename_pattern"];
   m_max_age=cfg["max_age"];
   m_dump_interval=cfg["dump_interval"];
+  m_inputURI=cfg.value("inputURI",""); // default: archive_uri of the metrics settings
+  m_stop_writer=false;
 }
 
-HistogramArchiverModule::~HistogramArchiverModule() { 
+HistogramArchiverModule::~HistogramArchiverModule() {
 }
 
 // optional (configuration can be handled in the constructor)
 void HistogramArchiverModule::configure() {
   FaserProcess::configure();
   ERS_INFO("");
-  char temp [ 1000 ];
-  std::string path=getcwd(temp,1000);
-  size_t bidx=path.rfind("/");
-  m_archive_command=path.substr(0,bidx)+"/scripts/archiveHists.py";
-  if (access( m_archive_command.c_str(), X_OK ) != 0 ) {
+  if (m_inputURI.empty()) m_inputURI=m_config.getMetricsSettings().value("archive_uri","");
+  if (m_inputURI.empty()) {
     m_status=STATUS_ERROR;
-    ERS_ERROR("Failed to find archive command or not executable: "+m_archive_command);
+    ERS_ERROR("No archive_uri in the metrics settings to receive histograms on");
+    return;
   }
-}
+  m_context=std::make_unique<zmq::context_t>(1);
+  m_input=std::make_unique<zmq::socket_t>(*m_context,ZMQ_SUB);
+  m_input->setsockopt(ZMQ_RCVTIMEO,100); // ms, to check for archiving and end of run
+  m_input->setsockopt(ZMQ_SUBSCRIBE,"",0);
+  m_input->bind(m_inputURI);
+  ERS_INFO("Archiving histograms received on "+m_inputURI);
 
-void HistogramArchiverModule::start(unsigned run_num) {
-  FaserProcess::start(run_num);
-  ERS_INFO("");
-  m_runnumber=run_num;
-  m_file_index=0;
-  m_last_archive=time(0);
-}
-
-void HistogramArchiverModule::stop() {
-  archive();
-  FaserProcess::stop();
-  ERS_INFO("");
+  registerVariable(m_received,"histograms_received",metrics::RATE);
+  registerVariable(m_archived,"histograms_archived",metrics::RATE);
+  registerVariable(m_archive_bytes,"archive_bytes",metrics::LAST_VALUE);
 }
 
 template<typename ... Args>
@@ -61,36 +60,128 @@ std::string string_format( const std::string& format, Args ... args )
     return std::string( buf.get(), buf.get() + size - 1 ); // We don't want the '\0' inside
 }
 
-
-void HistogramArchiverModule::archive() {
+void HistogramArchiverModule::start(unsigned run_num) {
+  FaserProcess::start(run_num);
+  ERS_INFO("");
+  m_runnumber=run_num;
+  m_last_archive=time(0);
+  m_histograms.clear();
+  m_archive.reset();
   DEBUG("pattern: "+m_filename_pattern);
   try {
-    std::string hist_name=string_format(m_filename_pattern,m_runnumber,m_file_index);
-    ERS_INFO("Archiving histograms to "+hist_name);
-    std::string full_command=m_archive_command+" "+std::to_string(m_max_age)+" "+hist_name;
-    DEBUG("Full command: "+full_command);
-    int rc=system(full_command.c_str());
-    if (rc) {
-      m_status=STATUS_ERROR;
-      ERS_ERROR("Got errors during archiving");
-    }
-    m_last_archive=time(0);
-    m_file_index++;
+    // the second number counts archives of the same run, e.g. after a restart
+    std::string file_name;
+    struct stat info;
+    for(int file_index=0; file_index==0 || stat(file_name.c_str(),&info)==0; file_index++)
+      file_name=string_format(m_filename_pattern,m_runnumber,file_index);
+    ERS_INFO("Archiving histograms to "+file_name);
+    m_archive=std::make_unique<HistogramArchive>(file_name);
   } catch (std::runtime_error &e) {
     m_status=STATUS_ERROR;
-    m_last_archive=time(0);  //to avoid repeated failures every second
-    ERS_ERROR("Failed to generate outputfile name");
+    ERS_ERROR("Failed to open archive file: "+std::string(e.what()));
+  }
+  m_stop_writer=false;
+  m_writer=std::thread(&HistogramArchiverModule::writer,this);
+}
+
+void HistogramArchiverModule::stop() {
+  FaserProcess::stop();
+  archive();
+  {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    m_stop_writer=true;
+  }
+  m_pending_cv.notify_all();
+  if (m_writer.joinable()) m_writer.join();
+  ERS_INFO("");
+}
+
+/**
+ * Hands the histograms changed since the last call to the writer thread, and forgets
+ * those not received for max_age, e.g. from monitors that are no longer running.
+ */
+void HistogramArchiverModule::archive() {
+  std::vector<HistogramArchive::Record> records;
+  double now=time(0);
+  for(auto hist=m_histograms.begin(); hist!=m_histograms.end();) {
+    if (hist->second.changed) {
+      records.push_back({hist->first.first,hist->second.schema,hist->second.values,hist->second.timestamp});
+      hist->second.changed=false;
+    }
+    if (now-hist->second.timestamp>m_max_age) hist=m_histograms.erase(hist);
+    else ++hist;
+  }
+  m_last_archive=time(0);
+  if (records.empty()) return;
+  DEBUG("Archiving "<<records.size()<<" histograms");
+  {
+    std::lock_guard<std::mutex> lock(m_pending_mutex);
+    m_pending.push_back(std::move(records));
+  }
+  m_pending_cv.notify_all();
+}
+
+void HistogramArchiverModule::writer() {
+  std::unique_lock<std::mutex> lock(m_pending_mutex);
+  while (true) {
+    m_pending_cv.wait(lock,[this]{ return m_stop_writer || !m_pending.empty(); });
+    if (m_pending.empty()) break; // stopped with nothing left to write
+    auto records=std::move(m_pending.front());
+    m_pending.pop_front();
+    lock.unlock();
+    if (m_archive) {
+      try {
+        for(auto& record : records) m_archive->write(record);
+        m_archive->flush();
+        m_archived+=records.size();
+        m_archive_bytes=m_archive->bytes();
+      } catch (std::runtime_error &e) {
+        m_status=STATUS_ERROR;
+        ERS_ERROR("Failed to archive histograms: "+std::string(e.what()));
+      }
+    }
+    lock.lock();
+  }
+}
+
+void HistogramArchiverModule::receive(zmq::message_t& message) {
+  HistogramMessage msg;
+  if (!msg.split(static_cast<const char*>(message.data()),message.size())) return;
+  m_received++;
+  json schema;
+  std::vector<float> values;
+  if (!msg.decode(schema,values)) {
+    WARNING("Failed to decode histogram from "<<msg.source);
     return;
   }
+  std::string name=schema.value("name","");
+  bool delta=schema.value("delta",false);
+  auto hist=m_histograms.find({msg.source,name});
+  if (delta) { // changed bins only
+    if (hist==m_histograms.end()) return; // wait for the next full publication
+    auto& contents=hist->second.values;
+    auto& bins=schema["bins"];
+    for(size_t ii=0; ii<bins.size() && ii<values.size(); ii++) {
+      unsigned bin=bins[ii];
+      if (bin<contents.size()) contents[bin]=values[ii];
+    }
+  }
+  else hist=m_histograms.insert_or_assign({msg.source,name},Histogram{std::move(schema),std::move(values),0,false}).first;
+  hist->second.timestamp=time(0);
+  hist->second.changed=true;
 }
 
 void HistogramArchiverModule::runner() noexcept {
   ERS_INFO("Running...");
   while (m_run) {
+    if (m_input) {
+      zmq::message_t message;
+      if (m_input->recv(&message)) receive(message);
+    }
+    else sleep(1);
     if (time(0)-m_last_archive>=m_dump_interval) {
       archive();
     }
-    sleep(1);
   }
   ERS_INFO("Runner stopped");
 }
@@ -3,11 +3,24 @@
 */
 
 #pragma once
+#include <condition_variable>
 #include <cstdlib>
 #include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "Commons/FaserProcess.hpp"
+#include "zmq.hpp"
+#include "HistogramArchive.hpp"
 
+/**
+ * Keeps the latest contents of all histograms monitors publish to the archive_uri of the
+ * metrics settings, and every dump_interval appends those that changed to the archive file
+ * of the run, on a separate writer thread.
+ */
 class HistogramArchiverModule : public FaserProcess {
  public:
   HistogramArchiverModule(const std::string& n);
@@ -20,12 +33,36 @@ class HistogramArchiverModule : public FaserProcess {
 
   void runner() noexcept;
 private:
+  struct Histogram {
+    json schema;   // as in the JSON format, without bin contents
+    std::vector<float> values;
+    double timestamp; // of the last update, in seconds since epoch
+    bool changed;
+  };
+  void receive(zmq::message_t& message);
+  void writer();
+
   unsigned m_runnumber;
-  std::string m_archive_command;
+  std::string m_inputURI;
   std::string m_filename_pattern;
   int m_max_age;       // in seconds
   int m_dump_interval; // in seconds
-  
-  int m_file_index;
+
   time_t m_last_archive;
+
+  std::unique_ptr<zmq::context_t> m_context;
+  std::unique_ptr<zmq::socket_t> m_input;
+  std::map<std::pair<std::string,std::string>,Histogram> m_histograms; // by source and name
+
+  // records handed to the writer thread
+  std::unique_ptr<HistogramArchive> m_archive;
+  std::deque<std::vector<HistogramArchive::Record>> m_pending;
+  std::mutex m_pending_mutex;
+  std::condition_variable m_pending_cv;
+  std::thread m_writer;
+  bool m_stop_writer;
+
+  std::atomic<int> m_received;
+  std::atomic<int> m_archived;
+  std::atomic<size_t> m_archive_bytes;
 };
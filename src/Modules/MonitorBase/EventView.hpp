@@ -0,0 +1,124 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * Read-only view of a fragment inside a received event buffer. Accessors follow
+ * DAQFormats::EventFragment, but nothing is copied: the view is only valid as long
+ * as the buffer it was created from.
+ */
+class FragmentView {
+public:
+  FragmentView(const uint8_t* data) : m_data(data) {}
+
+  uint8_t  fragment_tag() const { return m_data[1]; }
+  uint16_t trigger_bits() const { return get<uint16_t>(2); }
+  uint16_t version() const { return get<uint16_t>(4); }
+  uint16_t header_size() const { return get<uint16_t>(6); }
+  uint32_t payload_size() const { return get<uint32_t>(8); }
+  uint32_t source_id() const { return get<uint32_t>(12); }
+  uint64_t event_id() const { return get<uint64_t>(16); }
+  uint16_t bc_id() const { return get<uint16_t>(24); }
+  uint16_t status() const { return get<uint16_t>(26); }
+  uint64_t timestamp() const { return get<uint64_t>(28); }
+  uint32_t size() const { return header_size()+payload_size(); }
+
+  template <typename T=const void*> T payload() const {
+    return reinterpret_cast<T>(m_data+header_size());
+  }
+
+  static constexpr uint8_t marker = 0xAA;
+  static constexpr size_t minHeaderSize = 36;
+
+private:
+  template <typename T> T get(size_t pos) const {
+    T value;
+    std::memcpy(&value,m_data+pos,sizeof(T));
+    return value;
+  }
+  const uint8_t* m_data;
+};
+
+/**
+ * Read-only view of an event as received from the event builder. Only the event
+ * header is decoded, together with a table of where each fragment starts, so looking
+ * up a fragment does not copy any data. Accessors follow DAQFormats::EventFull.
+ * The view refers to the received buffer, which must outlive it.
+ */
+class EventView {
+public:
+  EventView() : m_data(nullptr) {}
+
+  /// Points the view to a new event buffer, throws std::runtime_error if it is malformed
+  void reset(const uint8_t* data, size_t size) {
+    m_data=nullptr;
+    m_fragments.clear();
+    if (size<minHeaderSize) throw std::runtime_error("Event buffer too small for event header");
+    m_data=data;
+    if (data[0]!=marker) throw std::runtime_error("Event marker not found");
+    if (header_size()<minHeaderSize || this->size()!=size)
+      throw std::runtime_error("Event size ("+std::to_string(this->size())+") does not match buffer size ("+std::to_string(size)+")");
+    size_t pos=header_size();
+    for(unsigned int ii=0;ii<fragment_count();ii++) {
+      if (pos+FragmentView::minHeaderSize>size) throw std::runtime_error("Fragment header beyond end of event");
+      FragmentView fragment(data+pos);
+      if (data[pos]!=FragmentView::marker) throw std::runtime_error("Fragment marker not found");
+      if (fragment.header_size()<FragmentView::minHeaderSize || pos+fragment.size()>size)
+	throw std::runtime_error("Fragment extends beyond end of event");
+      m_fragments.push_back(fragment);
+      pos+=fragment.size();
+    }
+    // keep source ID order, as for EventFull
+    std::sort(m_fragments.begin(),m_fragments.end(),
+	      [](const FragmentView& a, const FragmentView& b) { return a.source_id()<b.source_id(); });
+  }
+
+  uint8_t  event_tag() const { return m_data[1]; }
+  uint16_t trigger_bits() const { return get<uint16_t>(2); }
+  uint16_t version() const { return get<uint16_t>(4); }
+  uint16_t header_size() const { return get<uint16_t>(6); }
+  uint32_t payload_size() const { return get<uint32_t>(8); }
+  uint8_t  fragment_count() const { return m_data[12]; }
+  uint32_t run_number() const { return get<uint32_t>(12)>>8; }
+  uint64_t event_id() const { return get<uint64_t>(16); }
+  uint64_t event_counter() const { return get<uint64_t>(24); }
+  uint16_t bc_id() const { return get<uint16_t>(32); }
+  uint16_t status() const { return get<uint16_t>(34); }
+  uint64_t timestamp() const { return get<uint64_t>(36); }
+  uint32_t size() const { return header_size()+payload_size(); }
+  const uint8_t* data() const { return m_data; }
+
+  std::vector<uint32_t> getFragmentIDs() const {
+    std::vector<uint32_t> ids;
+    ids.reserve(m_fragments.size());
+    for(auto& fragment : m_fragments) ids.push_back(fragment.source_id());
+    return ids;
+  }
+
+  /// Returns the fragment from the given source, or nullptr if there is none
+  const FragmentView* find_fragment(uint32_t source_id) const {
+    for(auto& fragment : m_fragments)
+      if (fragment.source_id()==source_id) return &fragment;
+    return nullptr;
+  }
+
+  static constexpr uint8_t marker = 0xBB;
+  static constexpr size_t minHeaderSize = 44;
+
+private:
+  template <typename T> T get(size_t pos) const {
+    T value;
+    std::memcpy(&value,m_data+pos,sizeof(T));
+    return value;
+  }
+  const uint8_t* m_data;
+  std::vector<FragmentView> m_fragments; // a handful of fragments - linear search is fastest
+};
@@ -0,0 +1,33 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "EventFormats/DAQFormats.hpp"
+
+/**
+ * Tables of the fragment error accounting in MonitorBaseModule, indexed by status bit
+ * (UnclassifiedError ... DuplicateFragment).
+ */
+namespace FragmentErrors {
+  constexpr unsigned kErrorBits = 10;
+
+  /// Categories of the fragment_errors histogram
+  inline const std::vector<std::string> kCategories = {"Unclassified", "BCIDMistmatch", "TagMismatch", "Timeout", "Overflow",
+                                                       "Corrupted", "Dummy", "Missing", "Empty", "Duplicate", "DataUnpack"};
+
+  /// Histogram labels of the status bits. BCIDMismatch and CorruptedFragment are not among the
+  /// categories (BCIDMistmatch, Corrupted), so they end up in the unpublished overflow bin.
+  constexpr std::array<const char*,kErrorBits> kLabels = {
+    "Unclassified", "BCIDMismatch", "TagMismatch", "Timeout", "Overflow", "CorruptedFragment",
+    "Dummy", "Missing", "Empty", "Duplicate"
+  };
+
+  static_assert(DAQFormats::UnclassifiedError == 1 && DAQFormats::BCIDMismatch == 1<<1 &&
+                DAQFormats::CorruptedFragment == 1<<5 && DAQFormats::DuplicateFragment == 1<<9,
+                "status bits do not match error tables");
+}
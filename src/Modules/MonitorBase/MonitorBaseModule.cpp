@@ -18,9 +18,27 @@
 using namespace std::chrono_literals;
 using namespace std::chrono;
 using namespace MonitorBase;
+
+thread_local uint8_t MonitorBaseModule::m_eventTag = 0;
+thread_local EventView MonitorBaseModule::m_event;
+thread_local const FragmentView* MonitorBaseModule::m_fragment = 0;
+thread_local const RawFragment * MonitorBaseModule::m_rawFragment = 0;
+thread_local const MonitoringFragment * MonitorBaseModule::m_monitoringFragment = 0;
+thread_local std::shared_ptr<const TLBMonitoringFragment> MonitorBaseModule::m_tlbmonitoringFragment;
+thread_local std::shared_ptr<const TLBDataFragment> MonitorBaseModule::m_tlbdataFragment;
+thread_local std::shared_ptr<const DigitizerDataFragment> MonitorBaseModule::m_pmtdataFragment;
+thread_local std::shared_ptr<const TrackerDataFragment> MonitorBaseModule::m_trackerdataFragment;
+thread_local bool MonitorBaseModule::m_event_header_unpacked = false;
+thread_local std::map<std::pair<uint32_t,std::type_index>,std::shared_ptr<const void>> MonitorBaseModule::m_decodedFragments;
+const nlohmann::json* MonitorBaseModule::s_plugin_settings = nullptr;
+
 MonitorBaseModule::MonitorBaseModule(const std::string& n):FaserProcess(n) { 
    INFO("");
 
+   if (s_plugin_settings) {
+     m_is_plugin = true;
+     m_plugin_settings = *s_plugin_settings;
+   }
    auto cfg = getModuleSettings();
    auto cfg_sourceID = cfg["fragmentID"];
    if (cfg_sourceID!="" && cfg_sourceID!=nullptr)
@@ -35,16 +53,19 @@ MonitorBaseModule::MonitorBaseModule(const std::string& n):FaserProcess(n) {
 
 MonitorBaseModule::~MonitorBaseModule() { 
 
-  delete m_event;
-  if (m_trackerdataFragment) delete m_trackerdataFragment;
 
   INFO("With config: " << m_config.dump());
 }
 
+nlohmann::json MonitorBaseModule::getModuleSettings() {
+  if (m_is_plugin) return m_plugin_settings;
+  return FaserProcess::getModuleSettings();
+}
+
 void MonitorBaseModule::configure() {
   INFO("Configuring...");
 
-  FaserProcess::configure();
+  if (!m_host) FaserProcess::configure();
 
   m_filter_physics = false;
   m_filter_random = false;
@@ -78,40 +99,95 @@ void MonitorBaseModule::configure() {
     m_active_mon_lhc_modes = mod_cfgs["ActiveLHCModes"].get<std::vector<int>>();
   }
 
+  m_worker_threads = mod_cfgs.value("workerThreads", 0);
+  bool parallel = supportsWorkerThreads();
+  for (auto &plugin : m_plugins) parallel = parallel && plugin->supportsWorkerThreads();
+  if (m_worker_threads && !parallel && !m_host) {
+    WARNING("Ignoring workerThreads: "<<(m_plugins.empty() ? "this monitor" : "a hosted monitor")<<" does not support monitoring events in parallel.");
+    m_worker_threads = 0;
+  }
+  m_worker_queue_size = mod_cfgs.value("workerQueueSize", 100);
+  if (m_worker_queue_size < 2) m_worker_queue_size = 2;
+  if (m_worker_threads) INFO("Monitoring events on "<<m_worker_threads<<" worker threads.");
+  m_max_idle_wait = microseconds(mod_cfgs.value("maxIdleWait_us", 10000));
+
+  auto sampling = mod_cfgs.value("sampling", "off");
+  if (sampling == "off") m_sampling_mode = SAMPLING_OFF;
+  else if (sampling == "prescale") m_sampling_mode = SAMPLING_PRESCALE;
+  else if (sampling == "budget") m_sampling_mode = SAMPLING_BUDGET;
+  else throw ConfigurationIssue(ERS_HERE, "Unknown sampling mode '"+sampling+"' - must be 'off', 'prescale' or 'budget'.");
+  m_sampling_target = mod_cfgs.value("samplingTarget", 0.8);
+  if (m_sampling_target <= 0 || m_sampling_target > 1) throw ConfigurationIssue(ERS_HERE, "samplingTarget must be in (0,1].");
+  if (m_sampling_mode != SAMPLING_OFF) INFO("Sampling events when monitoring takes more than "<<100*m_sampling_target<<"% of the time.");
+  if (m_host) {
+    // events are received, distributed and sampled by the host
+    m_worker_threads = m_host->m_worker_threads;
+    m_sampling_mode = SAMPLING_OFF;
+  }
+
   register_metrics();
   register_fragment_error_metrics();
+  if (!m_host) {
+    registerVariable(m_metric_unpack_time, "unpack_time_us", metrics::AVERAGE);
+    registerVariable(m_metric_latency, "monitor_latency_us", metrics::AVERAGE);
+    if (m_worker_threads) registerVariable(m_metric_queued_events, "queued_events", metrics::AVERAGE);
+    registerVariable(m_metric_load, "monitoring_load", metrics::AVERAGE);
+    if (m_sampling_mode != SAMPLING_OFF) {
+      registerVariable(m_sampling_fraction, "sampling_fraction", metrics::AVERAGE);
+      registerVariable(m_metric_events_skipped, "events_skipped");
+    }
+  }
 
   m_histogramming_on = false;
   setupHistogramManager();
   register_hists();
   register_fragment_error_histogram();
+  if (m_worker_threads) m_histogrammanager->setShards(m_worker_threads);
+  if (m_sampling_mode != SAMPLING_OFF) m_histogrammanager->setSamplingCounters(&m_events_received, &m_events_sampled);
+  else if (m_host && m_host->m_sampling_mode != SAMPLING_OFF) m_histogrammanager->setSamplingCounters(&m_host->m_events_received, &m_host->m_events_sampled);
 
-  // check if waiting for BOBR data
+  // check if waiting for BOBR data, all other receivers deliver events
   m_store_bobr_data = false;
-  auto connections = m_config.getConnections(getName());
+  m_bobr_channel = -1;
+  m_event_channels.clear();
+  auto connections = m_host ? nlohmann::json() : m_config.getConnections(getName());
   for ( auto &rcv: connections["receivers"] ){
-      if (rcv["connections"][0]["port"]==BOBR_MON_PORT){
+      if (!m_store_bobr_data && rcv["connections"][0]["port"]==BOBR_MON_PORT){
         INFO("Will store BOBR data during run...");
         m_store_bobr_data=true;
         m_bobr_channel = rcv["chid"];
         DEBUG("BOBR channel id = "<<m_bobr_channel);
-        break;
       }
+      else m_event_channels.push_back(rcv["chid"].get<unsigned>());
   }
   if (!m_store_bobr_data) INFO("Won't be storing BOBR data...");
 
-  if (m_store_bobr_data && m_active_mon_lhc_modes.size() == 0) {
+  bool bobr_data = m_store_bobr_data || (m_host && m_host->m_store_bobr_data);
+  if (bobr_data && m_active_mon_lhc_modes.size() == 0) {
     WARNING("Configured to received BOBR data, but no LHC active modes set. Adding stable beams to active modes, assuming this was intended.");
     m_active_mon_lhc_modes.push_back(STABLE_BEAM_MODE);
   }
 
+  for (auto &plugin : m_plugins) {
+    INFO("Configuring plugin monitor "<<plugin->getName());
+    plugin->configure();
+  }
+
   return;
 }
 
 void MonitorBaseModule::start(unsigned int run_num) {
-  FaserProcess::start(run_num);
+  if (!m_host) FaserProcess::start(run_num);
 
   m_status = STATUS_OK;
+  m_prescale = 1;
+  m_window_received = 0;
+  m_window_sampled = 0;
+  m_window_start = steady_clock::now();
+  m_busy_ns = 0;
+  m_sampling_fraction = 1;
+  m_metric_load = 0;
+  m_metric_events_skipped = 0;
   if ( m_histogramming_on ) m_histogrammanager->start();
   m_lhc_machinemode=-1;
   if (m_store_bobr_data) {
@@ -121,12 +197,15 @@ void MonitorBaseModule::start(unsigned int run_num) {
     }
     else m_bobrProcessThread = new std::thread(&MonitorBaseModule::process_bobr_data, this);
   }
+  else if (m_host && m_host->m_store_bobr_data) m_lhc_physics_mode=false;
+
+  for (auto &plugin : m_plugins) plugin->start(run_num);
 
 
 }
 
 void MonitorBaseModule::stop() {
-  FaserProcess::stop();
+  if (!m_host) FaserProcess::stop();
 
   INFO("... finalizing ...");
 
@@ -141,55 +220,186 @@ void MonitorBaseModule::stop() {
 
   if (m_histogramming_on) m_histogrammanager->stop();
 
+  for (auto &plugin : m_plugins) plugin->stop();
+
 }
 
 void MonitorBaseModule::runner() noexcept {
   INFO("Running...");
 
-  bool no_data(true);
   DataFragment<daqling::utilities::Binary> eventBuilderBinary;
-  nlohmann::json rcvs = m_config.getConnections(getName())["receivers"];
+  microseconds idle_wait(0);
+
+  m_stop_workers = false;
+  for (unsigned i = 0; i < m_worker_threads; i++) {
+    m_worker_queues.push_back(std::make_unique<EventQueue>(m_worker_queue_size));
+  }
+  for (unsigned i = 0; i < m_worker_threads; i++) {
+    m_workers.emplace_back(&MonitorBaseModule::worker, this, i);
+  }
+  unsigned next_worker(0);
 
   while (m_run) {
 
-      if (no_data) std::this_thread::sleep_for(10ms);
-      no_data=true;
-      for ( auto &rcv: rcvs ){
-        m_event_header_unpacked = false;
-        int chid = rcv["chid"].get<int>();
-        if (chid == m_bobr_channel) continue;
+      // when idle, back off from a short wait up to m_max_idle_wait, so that the
+      // first event after a quiet period is picked up quickly without spinning
+      if (idle_wait.count()) std::this_thread::sleep_for(idle_wait);
+      bool no_data(true);
+      for ( auto chid: m_event_channels ){
         if ( !m_connections.receive(chid, eventBuilderBinary)){
           continue;
         } else no_data = false;
+        auto received = steady_clock::now();
         //DEBUG("Received event with size "<<eventBuilderBinary.size());
-        try {
-          if (m_filter_physics && !is_physics_triggered(eventBuilderBinary)) continue;
-          if (m_filter_random && !is_random_triggered(eventBuilderBinary)) continue;
-          if (m_filter_led && !is_led_triggered(eventBuilderBinary)) continue;
-          monitor(eventBuilderBinary);
-        } catch (UnpackDataIssue &e) {
-          ERROR("Error checking data packet: "<<e.what()<<" Skipping event!");
+        if (!sample_event()) {
+          m_metric_events_skipped++;
+          continue;
+        }
+        if (m_worker_threads) {
+          // hand over to the next worker with space, waiting if all are busy
+          ReceivedEvent event{std::move(eventBuilderBinary), received};
+          while (!m_worker_queues[next_worker]->write(std::move(event)) && m_run) {
+            next_worker = (next_worker+1)%m_worker_threads;
+            if (next_worker == 0) std::this_thread::sleep_for(100us);
+          }
+          next_worker = (next_worker+1)%m_worker_threads;
+          int queued(0);
+          for (auto &queue : m_worker_queues) queued += queue->sizeGuess();
+          m_metric_queued_events = queued;
         }
+        else process_event(eventBuilderBinary, received);
       }
+      if (no_data) idle_wait = std::min(m_max_idle_wait, std::max(50us, 2*idle_wait));
+      else idle_wait = 0us;
 
-      // alert in case of high number of fragment errors
-      if (m_metric_total_errors > m_RED_LVL_ERRCNT && m_status<STATUS_ERROR) {
-           WARNING("Encountering large number of errors in data during monitoring! More than "<<m_RED_LVL_ERRCNT<<" errors encountered.");
-           m_status = STATUS_ERROR;
-      }
-      else if (m_metric_total_errors > m_ORANGE_LVL_ERRCNT && m_status<STATUS_WARN) {
-           WARNING("Encountering errors in data for monitoring. More than "<<m_ORANGE_LVL_ERRCNT<<" errors encountered.");
-           m_status = STATUS_WARN;
+      update_error_status();
+      for (auto &plugin : m_plugins) {
+        plugin->update_error_status();
+        if (plugin->m_status > m_status) m_status = plugin->m_status.load();
       }
 
   }
 
+  m_stop_workers = true;
+  for (auto &worker : m_workers) worker.join();
+  m_workers.clear();
+  m_worker_queues.clear();
+
   INFO("Runner stopped");
 
   return;
 
 }
 
+void MonitorBaseModule::update_error_status() {
+
+  // alert in case of high number of fragment errors
+  if (m_metric_total_errors > m_RED_LVL_ERRCNT && m_status<STATUS_ERROR) {
+       WARNING("Encountering large number of errors in data during monitoring! More than "<<m_RED_LVL_ERRCNT<<" errors encountered.");
+       m_status = STATUS_ERROR;
+  }
+  else if (m_metric_total_errors > m_ORANGE_LVL_ERRCNT && m_status<STATUS_WARN) {
+       WARNING("Encountering errors in data for monitoring. More than "<<m_ORANGE_LVL_ERRCNT<<" errors encountered.");
+       m_status = STATUS_WARN;
+  }
+
+}
+
+bool MonitorBaseModule::monitor_event(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
+
+  try {
+    if (m_filter_physics && !is_physics_triggered(eventBuilderBinary)) return false;
+    if (m_filter_random && !is_random_triggered(eventBuilderBinary)) return false;
+    if (m_filter_led && !is_led_triggered(eventBuilderBinary)) return false;
+    monitor(eventBuilderBinary);
+  } catch (UnpackDataIssue &e) {
+    ERROR("Error checking data packet: "<<e.what()<<" Skipping event!");
+    return false;
+  }
+  return true;
+
+}
+
+void MonitorBaseModule::process_event(DataFragment<daqling::utilities::Binary> &eventBuilderBinary, steady_clock::time_point received) {
+
+  auto t0 = steady_clock::now();
+  m_event_header_unpacked = false;
+  bool monitored = monitor_event(eventBuilderBinary);
+  // plugins find the event header and fragments already decoded by whoever needed them first
+  for (auto &plugin : m_plugins) monitored |= plugin->monitor_event(eventBuilderBinary);
+  if (monitored) m_metric_latency = duration_cast<nanoseconds>(steady_clock::now()-received).count()/1000.;
+  m_busy_ns += duration_cast<nanoseconds>(steady_clock::now()-t0).count();
+
+}
+
+/**
+ * Decides whether the next received event is monitored. Once a second the fraction of time
+ * spent monitoring is compared to the target, and in prescale mode the prescale is adjusted
+ * such that the expected load matches the target. In budget mode events are taken until the
+ * time budget of the current second is used up. The fraction of events monitored over the
+ * last second is published, histograms are scaled by the events received and monitored since
+ * their last reset.
+ */
+bool MonitorBaseModule::sample_event() {
+
+  auto now = steady_clock::now();
+  auto window = duration_cast<nanoseconds>(now-m_window_start);
+  if (window >= 1s) {
+    unsigned threads = std::max(1u, m_worker_threads);
+    double load = double(m_busy_ns.exchange(0))/(window.count()*threads);
+    m_metric_load = load;
+    if (m_sampling_mode == SAMPLING_PRESCALE) {
+      if (load > m_sampling_target)
+        m_prescale = std::min(1000000u, unsigned(std::ceil(m_prescale*load/m_sampling_target)));
+      else if (load < 0.5*m_sampling_target && m_prescale > 1)
+        m_prescale = std::max(1u, unsigned(m_prescale*load/m_sampling_target));
+    }
+    m_sampling_fraction = m_window_received ? float(m_window_sampled)/m_window_received : 1.;
+    m_window_received = 0;
+    m_window_sampled = 0;
+    m_window_start = now;
+    window = 0ns;
+  }
+
+  m_window_received++;
+  m_events_received++;
+  bool sample = true;
+  switch (m_sampling_mode) {
+    case SAMPLING_PRESCALE:
+      sample = (m_window_received % m_prescale) == 0;
+      break;
+    case SAMPLING_BUDGET:
+      sample = m_busy_ns < m_sampling_target*std::max(1u, m_worker_threads)*1e9;
+      break;
+    default:
+      break;
+  }
+  if (sample) {
+    m_window_sampled++;
+    m_events_sampled++;
+  }
+  return sample;
+
+}
+
+void MonitorBaseModule::worker(unsigned workerId) noexcept {
+
+  HistogramManager::setThreadShard(workerId);
+  EventQueue &queue = *m_worker_queues[workerId];
+
+  // finish queued events after the run is stopped, so they make it into the final publish
+  while (!m_stop_workers || !queue.isEmpty()) {
+    auto event = queue.frontPtr();
+    if (!event) {
+      std::this_thread::sleep_for(100us);
+      continue;
+    }
+    process_event(event->data, event->received);
+    queue.popFront();
+  }
+
+}
+
 void MonitorBaseModule::process_bobr_data() noexcept {
 
   INFO("Running...");
@@ -226,7 +436,7 @@ bool MonitorBaseModule::is_physics_triggered(DataFragment<daqling::utilities::Bi
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) throw UnpackDataIssue(ERS_HERE, "Error unpacking event header.");
 
-  auto trig_bits = m_event->trigger_bits();
+  auto trig_bits = m_event.trigger_bits();
   if ( 0xF & trig_bits) return true;
   else return false; 
 
@@ -237,7 +447,7 @@ bool MonitorBaseModule::is_random_triggered(DataFragment<daqling::utilities::Bin
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) throw UnpackDataIssue(ERS_HERE, "Error unpacking event header.");
 
-  auto trig_bits = m_event->trigger_bits();
+  auto trig_bits = m_event.trigger_bits();
   if ( 0x10 & trig_bits) return true;
   else return false; 
 
@@ -248,7 +458,7 @@ bool MonitorBaseModule::is_led_triggered(DataFragment<daqling::utilities::Binary
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) throw UnpackDataIssue(ERS_HERE, "Error unpacking event header.");
 
-  auto trig_bits = m_event->trigger_bits();
+  auto trig_bits = m_event.trigger_bits();
   if ( 0x20 & trig_bits) return true;
   else return false; 
 
@@ -270,13 +480,18 @@ void MonitorBaseModule::register_fragment_error_metrics() {
    registerVariable(m_metric_error_empty, "error_empty");
    registerVariable(m_metric_error_duplicate, "error_duplicate");
    registerVariable(m_metric_total_errors, "error_total");
+
+   m_error_metrics = {&m_metric_error_unclassified, &m_metric_error_bcidmismatch, &m_metric_error_tagmismatch,
+                      &m_metric_error_timeout, &m_metric_error_overflow, &m_metric_error_corrupted,
+                      &m_metric_error_dummy, &m_metric_error_missing, &m_metric_error_empty,
+                      &m_metric_error_duplicate};
    return;
 
 }
 
 void MonitorBaseModule::register_fragment_error_histogram() {
-  std::vector<std::string> categories = {"Unclassified", "BCIDMistmatch", "TagMismatch", "Timeout", "Overflow","Corrupted", "Dummy", "Missing", "Empty", "Duplicate", "DataUnpack"};
-  m_histogrammanager->registerHistogram("fragment_errors", "error type", categories, m_PUBINT );
+  m_error_hist = m_histogrammanager->registerHistogram("fragment_errors", "error type", FragmentErrors::kCategories, m_PUBINT );
+  for (unsigned bit = 0; bit < kErrorBits; bit++) m_error_bins[bit] = m_histogrammanager->categoryBin(m_error_hist, FragmentErrors::kLabels[bit]);
 }
 
 void MonitorBaseModule::register_hists() {
@@ -290,24 +505,15 @@ uint16_t MonitorBaseModule::store( DataFragment<daqling::utilities::Binary> &bob
   uint16_t dataStatus(0);
 
   try {
-    EventFull event(bobrEventBinary.data<const uint8_t*>(),bobrEventBinary.size());
-    const EventFragment* fragment=event.find_fragment(DAQFormats::SourceIDs::BOBRSourceID);
+    EventView event;
+    event.reset(bobrEventBinary.data<const uint8_t*>(),bobrEventBinary.size());
+    const FragmentView* fragment=event.find_fragment(DAQFormats::SourceIDs::BOBRSourceID);
     if (fragment==0) {
       ERROR("No correct fragment source ID found.");
       return dataStatus |= MissingFragment;
     }
     BOBRDataFragment bobr_data_frag = BOBRDataFragment(fragment->payload<const uint32_t*>(), fragment->payload_size());
-    if (m_lhc_machinemode<0 || m_lhc_machinemode!=bobr_data_frag.machinemode()){
-      m_lhc_machinemode= bobr_data_frag.machinemode();
-      if (std::find(m_active_mon_lhc_modes.begin(), m_active_mon_lhc_modes.end(),m_lhc_machinemode)!=m_active_mon_lhc_modes.end()){
-        INFO("In LHC machine mode "<<m_lhc_machinemode<<". Activating monitoring for physics.");
-        m_lhc_physics_mode=true;
-      }
-      else { 
-        INFO("In LHC machine mode "<<m_lhc_machinemode<<". Deactivating monitoring for physics.");
-        m_lhc_physics_mode=false;
-      }
-    }
+    set_lhc_machinemode(bobr_data_frag.machinemode());
   } catch (const std::runtime_error& e) {
     ERROR(e.what());
     return dataStatus |= CorruptedFragment;
@@ -316,12 +522,32 @@ uint16_t MonitorBaseModule::store( DataFragment<daqling::utilities::Binary> &bob
 
 }
 
+void MonitorBaseModule::set_lhc_machinemode(int mode) {
+
+  if (m_lhc_machinemode<0 || m_lhc_machinemode!=mode){
+    m_lhc_machinemode= mode;
+    if (std::find(m_active_mon_lhc_modes.begin(), m_active_mon_lhc_modes.end(),m_lhc_machinemode)!=m_active_mon_lhc_modes.end()){
+      INFO("In LHC machine mode "<<m_lhc_machinemode<<". Activating monitoring for physics.");
+      m_lhc_physics_mode=true;
+    }
+    else { 
+      INFO("In LHC machine mode "<<m_lhc_machinemode<<". Deactivating monitoring for physics.");
+      m_lhc_physics_mode=false;
+    }
+  }
+  // plugins may be active in different LHC modes
+  for (auto &plugin : m_plugins) plugin->set_lhc_machinemode(mode);
+
+}
+
 uint16_t MonitorBaseModule::unpack_event_header( DataFragment<daqling::utilities::Binary> &eventBuilderBinary ) {
 
   uint16_t dataStatus(0);
+  if (m_event_header_unpacked) return dataStatus; // already done for this event, e.g. by the trigger filter
+
+  auto t0=steady_clock::now();
   try {
-    if (m_event) delete m_event;
-    m_event = new EventFull(eventBuilderBinary.data<const uint8_t*>(),eventBuilderBinary.size()); //BP note that this unpacks full event
+    m_event.reset(eventBuilderBinary.data<const uint8_t*>(),eventBuilderBinary.size()); // header and fragment table only, no copy
   } catch (const std::runtime_error& e) {
     ERROR(e.what());
     dataStatus |= CorruptedFragment;
@@ -334,8 +560,10 @@ uint16_t MonitorBaseModule::unpack_event_header( DataFragment<daqling::utilities
     fill_fragment_error_status_to_histogram(dataStatus);
     return dataStatus;
   }
+  m_metric_unpack_time = duration_cast<nanoseconds>(steady_clock::now()-t0).count()/1000.;
   m_event_header_unpacked = true;
-  m_eventTag = m_event->event_tag();
+  m_decodedFragments.clear();
+  m_eventTag = m_event.event_tag();
   
   return  dataStatus;
 
@@ -350,7 +578,7 @@ uint16_t MonitorBaseModule::unpack_fragment_header( DataFragment<daqling::utilit
     if (dataStatus) return dataStatus;
   }
 
-  m_fragment=m_event->find_fragment(sourceID);
+  m_fragment=m_event.find_fragment(sourceID);
   if (m_fragment==0) {
     ERROR("No correct fragment source ID found.");
     dataStatus |= MissingFragment;
@@ -384,16 +612,15 @@ uint16_t MonitorBaseModule::unpack_full_fragment( DataFragment<daqling::utilitie
     case PhysicsTag: case CorruptedTag: case IncompleteTag:{
       switch (sourceID&0xFFFFFF00) {
         case TriggerSourceID:
-          m_tlbdataFragment = std::make_unique<TLBDataFragment>(TLBDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size()));
+          m_tlbdataFragment = decoded_fragment<TLBDataFragment>(sourceID);
           DEBUG("unpacking TLB data fragment.");
           break;
         case PMTSourceID:
-          m_pmtdataFragment = std::make_unique<DigitizerDataFragment>(DigitizerDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size()));
+          m_pmtdataFragment = decoded_fragment<DigitizerDataFragment>(sourceID);
           DEBUG("unpacking PMT data fragment.");
           break;
         case TrackerSourceID:
-          if (m_trackerdataFragment) delete m_trackerdataFragment;
-          m_trackerdataFragment = new TrackerDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size());
+          m_trackerdataFragment = decoded_fragment<TrackerDataFragment>(sourceID);
           DEBUG("unpacking Tracker data fragment.");
           break;
         default:
@@ -411,7 +638,7 @@ uint16_t MonitorBaseModule::unpack_full_fragment( DataFragment<daqling::utilitie
       DEBUG("unpacking monitoring fragment.");
       break;
     case TLBMonitoringTag:
-      m_tlbmonitoringFragment= std::make_unique<TLBMonitoringFragment>(TLBMonitoringFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size()));
+      m_tlbmonitoringFragment = decoded_fragment<TLBMonitoringFragment>(sourceID);
       DEBUG("unpacking TLB monitoring fragment.");
       break;
     default:
@@ -422,34 +649,45 @@ uint16_t MonitorBaseModule::unpack_full_fragment( DataFragment<daqling::utilitie
   return dataStatus;
 }
 
-TrackerDataFragment MonitorBaseModule::get_tracker_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint8_t boardId) {
+template<typename T> std::shared_ptr<const T> MonitorBaseModule::decoded_fragment(uint32_t sourceID) {
+
+  auto& decoded = m_decodedFragments[std::make_pair(sourceID,std::type_index(typeid(T)))];
+  if (!decoded) {
+    const FragmentView* fragment = m_event.find_fragment(sourceID);
+    if (!fragment) throw UnpackDataIssue(ERS_HERE, "Fragment to decode not found.");
+    decoded = std::make_shared<const T>(fragment->payload<const uint32_t*>(), fragment->payload_size());
+  }
+  return std::static_pointer_cast<const T>(decoded);
+}
+
+const TrackerDataFragment& MonitorBaseModule::get_tracker_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint8_t boardId) {
 
   if (unpack_fragment_header(eventBuilderBinary, TrackerSourceID+boardId)) throw UnpackDataIssue(ERS_HERE, "Issue encountered while unpacking fragment information.");
 
-  return TrackerDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size());
+  return *decoded_fragment<TrackerDataFragment>(TrackerSourceID+boardId);
 }
 
-TLBDataFragment MonitorBaseModule::get_tlb_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
+const TLBDataFragment& MonitorBaseModule::get_tlb_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
 
   if (m_eventTag == TLBMonitoringTag) throw UnpackDataIssue(ERS_HERE,"Can't retrieve TLB data fragment: This is a monitoring event!");
   if (unpack_fragment_header(eventBuilderBinary, TriggerSourceID)) throw UnpackDataIssue(ERS_HERE, "Issue encountered while unpacking fragment information.");
 
-  return TLBDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size());
+  return *decoded_fragment<TLBDataFragment>(TriggerSourceID);
 }
 
-DigitizerDataFragment MonitorBaseModule::get_digitizer_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
+const DigitizerDataFragment& MonitorBaseModule::get_digitizer_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
 
   if (unpack_fragment_header(eventBuilderBinary, PMTSourceID)) throw UnpackDataIssue(ERS_HERE, "Issue encountered while unpacking fragment information.");
 
-  return DigitizerDataFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size());
+  return *decoded_fragment<DigitizerDataFragment>(PMTSourceID);
 }
 
-TLBMonitoringFragment MonitorBaseModule::get_tlb_monitoring_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
+const TLBMonitoringFragment& MonitorBaseModule::get_tlb_monitoring_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
 
   if (m_eventTag != TLBMonitoringTag) throw UnpackDataIssue(ERS_HERE,"Can't retrieve TLB monitoring fragment: This is not a TLB monitoring event!");
   if (unpack_fragment_header(eventBuilderBinary, TriggerSourceID)) throw UnpackDataIssue(ERS_HERE, "Issue encountered while unpacking fragment information.");
 
-  return TLBMonitoringFragment(m_fragment->payload<const uint32_t*>(), m_fragment->payload_size());
+  return *decoded_fragment<TLBMonitoringFragment>(TriggerSourceID);
 }
 
 uint16_t MonitorBaseModule::unpack_full_fragment( DataFragment<daqling::utilities::Binary> &eventBuilderBinary) {
@@ -462,13 +700,47 @@ void MonitorBaseModule::setupHistogramManager() {
   INFO("Setting up HistogramManager.");
   //INFO("Socket: "<<m_connections.getStatSocket());
 
-  m_histogrammanager = std::make_unique<HistogramManager>();
+  if (m_host) m_histogrammanager = std::make_unique<HistogramManager>(getName());
+  else m_histogrammanager = std::make_unique<HistogramManager>();
+
+  std::string format = m_host ? m_host->getModuleSettings().value("histogramFormat", "json") : "json";
+  format = getModuleSettings().value("histogramFormat", format);
+  if (format == "binary") m_histogrammanager->setBinaryFormat();
+  else if (format != "json") throw ConfigurationIssue(ERS_HERE, "Unknown histogramFormat '"+format+"' - must be 'json' or 'binary'.");
+  unsigned keyframes = m_host ? m_host->getModuleSettings().value("histogramKeyframes", 0) : 0;
+  keyframes = getModuleSettings().value("histogramKeyframes", keyframes);
+  if (keyframes) {
+    INFO("Publishing only changed histograms, in full every "<<keyframes<<" publish intervals.");
+    m_histogrammanager->setKeyframeInterval(keyframes);
+  }
+  unsigned compression = m_host ? m_host->getModuleSettings().value("histogramCompression", 0) : 0;
+  compression = getModuleSettings().value("histogramCompression", compression);
+  if (compression) {
+    INFO("Compressing histogram messages of at least "<<compression<<" bytes.");
+    m_histogrammanager->setCompression(compression);
+  }
+  auto &stats = m_histogrammanager->publishStats();
+  registerVariable(stats.bytes, "histogram_bytes", metrics::RATE);
+  registerVariable(stats.time_us, "histogram_publish_us", metrics::RATE);
+  registerVariable(stats.full, "histograms_published", metrics::RATE);
+  registerVariable(stats.memory, "histogram_memory_bytes", metrics::LAST_VALUE);
+  if (keyframes) {
+    registerVariable(stats.deltas, "histogram_deltas", metrics::RATE);
+    registerVariable(stats.skipped, "histograms_skipped", metrics::RATE);
+  }
+  if (compression) {
+    registerVariable(stats.compressed, "histograms_compressed", metrics::RATE);
+    registerVariable(stats.compress_us, "histogram_compress_us", metrics::RATE);
+    registerVariable(stats.compression_ratio, "histogram_compression_ratio", metrics::LAST_VALUE);
+  }
 
   auto statsURI = m_config.getMetricsSettings()["stats_uri"];
   if (statsURI != "" && statsURI != nullptr) {
     INFO("Stats uri provided. Will publish histograms via the stats connection.");
     try {
       m_histogrammanager->configure(1, statsURI); // NOTE 1 I/O thread, and using same statsURI as for metrics. should be fine..
+      std::string archiveURI = m_config.getMetricsSettings().value("archive_uri", "");
+      if (!archiveURI.empty()) m_histogrammanager->connect(archiveURI);
     } catch (std::exception &e){
       m_status = STATUS_ERROR;
       sleep(1); // wait for error state to appear in RC GUI.
@@ -486,16 +758,8 @@ void MonitorBaseModule::setupHistogramManager() {
 
 void MonitorBaseModule::fill_fragment_error_status_to_metric( uint32_t fragmentStatus ) {
 
-  if ( fragmentStatus  &  UnclassifiedError ) m_metric_error_unclassified += 1;
-  if ( fragmentStatus  &  BCIDMismatch ) m_metric_error_bcidmismatch += 1;
-  if ( fragmentStatus  &  TagMismatch ) m_metric_error_tagmismatch += 1;
-  if ( fragmentStatus  &  Timeout ) m_metric_error_timeout += 1;
-  if ( fragmentStatus  &  Overflow ) m_metric_error_overflow += 1;
-  if ( fragmentStatus  &  CorruptedFragment ) m_metric_error_corrupted += 1;
-  if ( fragmentStatus  &  DummyFragment ) m_metric_error_dummy += 1;
-  if ( fragmentStatus  &  MissingFragment ) m_metric_error_missing += 1;
-  if ( fragmentStatus  &  EmptyFragment ) m_metric_error_empty += 1;
-  if ( fragmentStatus  &  DuplicateFragment ) m_metric_error_duplicate += 1;
+  for (uint32_t bits = fragmentStatus & ((1u<<kErrorBits)-1); bits; bits &= bits-1)
+    (*m_error_metrics[__builtin_ctz(bits)]) += 1;
 
   if ( fragmentStatus ) m_metric_total_errors++;
   
@@ -503,19 +767,20 @@ void MonitorBaseModule::fill_fragment_error_status_to_metric( uint32_t fragmentS
 
 }
 
+void MonitorBaseModule::fill_fragment_error_status_to_histogram( uint32_t fragmentStatus ) {
+
+  for (uint32_t bits = fragmentStatus & ((1u<<kErrorBits)-1); bits; bits &= bits-1)
+    m_histogrammanager->fillBin(m_error_hist, m_error_bins[__builtin_ctz(bits)]);
+
+  return ;
+
+}
+
 void MonitorBaseModule::fill_fragment_error_status_to_histogram( uint32_t fragmentStatus, std::string hist_name ) {
 
-  if ( fragmentStatus  &  UnclassifiedError ) m_histogrammanager->fill(hist_name, "Unclassified");
-  if ( fragmentStatus  &  BCIDMismatch ) m_histogrammanager->fill(hist_name, "BCIDMismatch");
-  if ( fragmentStatus  &  TagMismatch ) m_histogrammanager->fill(hist_name, "TagMismatch");
-  if ( fragmentStatus  &  Timeout ) m_histogrammanager->fill(hist_name, "Timeout");
-  if ( fragmentStatus  &  Overflow ) m_histogrammanager->fill(hist_name, "Overflow");
-  if ( fragmentStatus  &  CorruptedFragment ) m_histogrammanager->fill(hist_name, "CorruptedFragment");
-  if ( fragmentStatus  &  DummyFragment ) m_histogrammanager->fill(hist_name, "Dummy");
-  if ( fragmentStatus  &  MissingFragment ) m_histogrammanager->fill(hist_name, "Missing");
-  if ( fragmentStatus  &  EmptyFragment ) m_histogrammanager->fill(hist_name, "Empty");
-  if ( fragmentStatus  &  DuplicateFragment ) m_histogrammanager->fill(hist_name, "Duplicate");
-  
+  for (uint32_t bits = fragmentStatus & ((1u<<kErrorBits)-1); bits; bits &= bits-1)
+    m_histogrammanager->fill(hist_name, FragmentErrors::kLabels[__builtin_ctz(bits)]);
+
   return ;
 
 }
@@ -3,10 +3,15 @@
 */
 #pragma once
 
+#include <array>
 #include <tuple>
 #include <list>
+#include <map>
+#include <memory>
+#include <typeindex>
 
 #include "Commons/FaserProcess.hpp"
+#include "folly/ProducerConsumerQueue.h"
 #include "EventFormats/DAQFormats.hpp"
 // import all existing data formats
 #include "EventFormats/RawExampleFormat.hpp"
@@ -16,6 +21,8 @@
 #include "EventFormats/TrackerDataFragment.hpp"
 #include "EventFormats/BOBRDataFragment.hpp"
 
+#include "EventView.hpp"
+#include "FragmentErrors.hpp"
 #include "Utils/HistogramManager.hpp"
 #include "Utils/Ers.hpp"
 #include "Exceptions/Exceptions.hpp"
@@ -53,21 +60,55 @@ class MonitorBaseModule : public FaserProcess {
 
  protected:
 
+  // settings of this module. For a monitor run as a plugin of a MonitorHost these are the
+  // settings given for the plugin in the host configuration
+  nlohmann::json getModuleSettings();
+
+  // metrics of a plugin are published by its host, prefixed with the plugin name
+  template<typename T, typename... Args>
+  void registerVariable(std::atomic<T> &var, const std::string& name, Args&&... args) {
+    if (m_host) m_host->registerVariable(var, getName()+"_"+name, std::forward<Args>(args)...);
+    else FaserProcess::registerVariable(var, name, std::forward<Args>(args)...);
+  }
+
+  /**
+   * Adds a monitor of type T that is run on every event received by this module, after
+   * this module's own monitor(). The plugin applies its own trigger filter and publishes
+   * its histograms under its own name, but shares the receiving, worker threads, sampling,
+   * BOBR data and per-event decode cache of this module. Call from the constructor.
+   */
+  template<class T> void add_plugin(const std::string& name, const nlohmann::json& settings) {
+    s_plugin_settings = &settings;
+    std::unique_ptr<MonitorBaseModule> plugin;
+    try {
+      plugin = std::make_unique<T>(name);
+    } catch (...) {
+      s_plugin_settings = nullptr;
+      throw;
+    }
+    s_plugin_settings = nullptr;
+    plugin->m_host = this;
+    m_plugins.push_back(std::move(plugin));
+  }
+
   // filled by json configs
   uint32_t m_sourceID=0;
-  uint8_t m_eventTag;
   unsigned m_PUBINT;
  
   // filled during running 
   bool m_lhc_physics_mode;
-  EventFull* m_event=0;
-  const EventFragment* m_fragment=0; // do not delete this one. Owned by m_event!
-  const RawFragment * m_rawFragment = 0 ; // do not delete this one. Owned by m_event!
-  const MonitoringFragment * m_monitoringFragment = 0 ; // ""
-  std::unique_ptr<TLBMonitoringFragment> m_tlbmonitoringFragment;
-  std::unique_ptr<TLBDataFragment> m_tlbdataFragment;
-  std::unique_ptr<DigitizerDataFragment> m_pmtdataFragment;
-  const TrackerDataFragment * m_trackerdataFragment = 0;
+
+  // per-event decode state. This is thread local, so that with workerThreads set each
+  // worker has its own while running monitor() on different events in parallel.
+  static thread_local uint8_t m_eventTag;
+  static thread_local EventView m_event; // refers to the event binary being monitored, only valid within monitor()
+  static thread_local const FragmentView* m_fragment; // do not delete this one. Owned by m_event!
+  static thread_local const RawFragment * m_rawFragment; // do not delete this one. Points into the event binary!
+  static thread_local const MonitoringFragment * m_monitoringFragment; // ""
+  static thread_local std::shared_ptr<const TLBMonitoringFragment> m_tlbmonitoringFragment;
+  static thread_local std::shared_ptr<const TLBDataFragment> m_tlbdataFragment;
+  static thread_local std::shared_ptr<const DigitizerDataFragment> m_pmtdataFragment;
+  static thread_local std::shared_ptr<const TrackerDataFragment> m_trackerdataFragment;
 
   // histogramming
   bool m_histogramming_on;
@@ -86,22 +127,36 @@ class MonitorBaseModule : public FaserProcess {
   std::atomic<int> m_metric_error_duplicate;
   std::atomic<int> m_metric_error_unpack;
   std::atomic<int> m_metric_total_errors;
+  std::atomic<float> m_metric_unpack_time; // in us
 
   // BOBR data to be stored
   std::atomic<int> m_lhc_machinemode;
 
   // functions 
+
+  /**
+   * Called for every received event passing the trigger filter. With workerThreads set,
+   * monitor() runs concurrently on several events and in no particular order, so it has to:
+   *  - keep per-event state in local variables or the thread local decode state above
+   *  - fill results only into histograms, which are sharded per worker and summed at
+   *    publish, or into std::atomic metrics
+   *  - protect any other state shared between events (running averages, counters that
+   *    are not atomic) itself, and not rely on the order in which events are seen
+   * Modules doing so return true from supportsWorkerThreads(), otherwise workerThreads is ignored.
+   */
   virtual void monitor(DataFragment<daqling::utilities::Binary>&);
+  virtual bool supportsWorkerThreads() const { return false; }
   virtual void register_hists( );
   virtual void register_metrics();
   uint16_t unpack_event_header( DataFragment<daqling::utilities::Binary> &eventBuilderBinary );
   uint16_t unpack_fragment_header( DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint32_t sourceID);
   uint16_t unpack_fragment_header( DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
   uint16_t unpack_full_fragment( DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint32_t sourceID);
-  TrackerDataFragment get_tracker_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint8_t boardId);
-  DigitizerDataFragment get_digitizer_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
-  TLBDataFragment get_tlb_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
-  TLBMonitoringFragment get_tlb_monitoring_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
+  // decoded fragments are cached per event, references are valid until the next event is unpacked
+  const TrackerDataFragment& get_tracker_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary, uint8_t boardId);
+  const DigitizerDataFragment& get_digitizer_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
+  const TLBDataFragment& get_tlb_data_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
+  const TLBMonitoringFragment& get_tlb_monitoring_fragment(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
   uint16_t unpack_full_fragment( DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
   bool is_physics_triggered(DataFragment<daqling::utilities::Binary>&);
   bool is_random_triggered(DataFragment<daqling::utilities::Binary>&);
@@ -110,13 +165,30 @@ class MonitorBaseModule : public FaserProcess {
 
  private:
 
-  bool m_event_header_unpacked;
+  static thread_local bool m_event_header_unpacked;
+
+  // plugin monitors, see add_plugin()
+  MonitorBaseModule* m_host = nullptr; // set for a plugin once added to its host
+  bool m_is_plugin = false;
+  nlohmann::json m_plugin_settings;
+  static const nlohmann::json* s_plugin_settings; // settings for the plugin being constructed
+  std::vector<std::unique_ptr<MonitorBaseModule>> m_plugins;
+  bool monitor_event(DataFragment<daqling::utilities::Binary>&);
+  void update_error_status();
+  void set_lhc_machinemode(int mode);
+
+  // decode cache for the current event, so that filters, monitor() and the get_*_fragment
+  // helpers decode each fragment at most once. Cleared when a new event header is unpacked.
+  static thread_local std::map<std::pair<uint32_t,std::type_index>,std::shared_ptr<const void>> m_decodedFragments;
+  template<typename T> std::shared_ptr<const T> decoded_fragment(uint32_t sourceID);
   bool m_filter_physics;
   bool m_filter_random;
   bool m_filter_led;
   bool m_store_bobr_data;
   std::thread *m_bobrProcessThread;
   int m_bobr_channel;
+  std::vector<unsigned> m_event_channels; // receiver channels carrying events, i.e. all but BOBR
+  std::chrono::microseconds m_max_idle_wait;
   std::vector<int> m_active_mon_lhc_modes;
 
   // constants
@@ -124,6 +196,40 @@ class MonitorBaseModule : public FaserProcess {
   const int m_ORANGE_LVL_ERRCNT = 10;
   const int m_RED_LVL_ERRCNT = 1000;
 
+  // optional pool of threads running monitor() in parallel, fed round-robin by runner()
+  struct ReceivedEvent {
+    DataFragment<daqling::utilities::Binary> data;
+    std::chrono::steady_clock::time_point received;
+  };
+  using EventQueue = folly::ProducerConsumerQueue<ReceivedEvent>;
+  unsigned m_worker_threads;
+  unsigned m_worker_queue_size;
+  std::atomic<bool> m_stop_workers;
+  std::vector<std::unique_ptr<EventQueue>> m_worker_queues;
+  std::vector<std::thread> m_workers;
+  std::atomic<int> m_metric_queued_events;
+  void worker(unsigned workerId) noexcept;
+  void process_event(DataFragment<daqling::utilities::Binary>&, std::chrono::steady_clock::time_point received);
+  std::atomic<float> m_metric_latency; // receive to end of monitor(), in us
+
+  // load-adaptive sampling: when monitoring takes more than m_sampling_target of the
+  // available time, only every m_prescale-th event (prescale mode) or only events up to
+  // that time budget per second (budget mode) are monitored
+  enum SamplingMode { SAMPLING_OFF=0, SAMPLING_PRESCALE, SAMPLING_BUDGET };
+  SamplingMode m_sampling_mode;
+  float m_sampling_target;
+  unsigned m_prescale;
+  unsigned m_window_received;
+  unsigned m_window_sampled;
+  std::chrono::steady_clock::time_point m_window_start;
+  std::atomic<int64_t> m_busy_ns; // time spent monitoring in the current window, summed over workers
+  std::atomic<float> m_sampling_fraction;
+  std::atomic<uint64_t> m_events_received{0}; // since configure, to scale histograms
+  std::atomic<uint64_t> m_events_sampled{0};
+  std::atomic<float> m_metric_load;
+  std::atomic<int> m_metric_events_skipped;
+  bool sample_event();
+
   void setupHistogramManager();
   // store BOBR info
   void process_bobr_data() noexcept;
@@ -131,6 +237,13 @@ class MonitorBaseModule : public FaserProcess {
   void register_fragment_error_metrics();
   void register_fragment_error_histogram();
   void fill_fragment_error_status_to_metric(uint32_t fragmentStatus);
-  void fill_fragment_error_status_to_histogram(uint32_t fragmentStatus, std::string hist_name="fragment_errors");
+  void fill_fragment_error_status_to_histogram(uint32_t fragmentStatus);
+  void fill_fragment_error_status_to_histogram(uint32_t fragmentStatus, std::string hist_name);
+
+  // error accounting is driven by tables indexed by status bit (see FragmentErrors.hpp), resolved at configure
+  static constexpr unsigned kErrorBits = FragmentErrors::kErrorBits;
+  std::array<std::atomic<int>*,kErrorBits> m_error_metrics;
+  std::array<int,kErrorBits> m_error_bins;
+  CategoryHistHandle m_error_hist;
 
 };
@@ -0,0 +1,45 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+/// \cond
+#include <functional>
+#include <map>
+/// \endcond
+
+#include "MonitorHostModule.hpp"
+#include "Modules/DigitizerMonitor/DigitizerMonitorModule.hpp"
+#include "Modules/EventMonitor/EventMonitorModule.hpp"
+#include "Modules/SCTDataMonitor/SCTDataMonitorModule.hpp"
+#include "Modules/TrackStationMonitor/TrackStationMonitorModule.hpp"
+#include "Modules/TriggerMonitor/TriggerMonitorModule.hpp"
+#include "Modules/TriggerRateMonitor/TriggerRateMonitorModule.hpp"
+
+MonitorHostModule::MonitorHostModule(const std::string& n):MonitorBaseModule(n) { 
+  INFO("In MonitorHostModule contructor");
+
+  using Factory = std::function<void(MonitorHostModule*, const std::string&, const nlohmann::json&)>;
+  static const std::map<std::string,Factory> factories = {
+    {"DigitizerMonitor",   &MonitorHostModule::add_plugin<DigitizerMonitorModule>},
+    {"EventMonitor",       &MonitorHostModule::add_plugin<EventMonitorModule>},
+    {"SCTDataMonitor",     &MonitorHostModule::add_plugin<SCTDataMonitorModule>},
+    {"TrackStationMonitor",&MonitorHostModule::add_plugin<TrackStationMonitorModule>},
+    {"TriggerMonitor",     &MonitorHostModule::add_plugin<TriggerMonitorModule>},
+    {"TriggerRateMonitor", &MonitorHostModule::add_plugin<TriggerRateMonitorModule>},
+  };
+
+  auto cfg = getModuleSettings();
+  for (auto &monitor : cfg["monitors"]) {
+    std::string name = monitor["name"];
+    std::string type = monitor["type"];
+    auto factory = factories.find(type);
+    if (factory == factories.end())
+      throw MonitorBase::ConfigurationIssue(ERS_HERE, "Monitor "+name+" has type "+type+", which cannot be hosted.");
+    INFO("Hosting monitor "<<name<<" of type "<<type);
+    factory->second(this, name, monitor.value("settings", nlohmann::json::object()));
+  }
+  if (cfg["monitors"].empty()) WARNING("No monitors configured to be hosted.");
+}
+
+MonitorHostModule::~MonitorHostModule() { 
+  INFO("With config: " << m_config.dump());
+}
@@ -0,0 +1,20 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include "Modules/MonitorBase/MonitorBaseModule.hpp"
+
+/**
+ * Runs several monitors in one process: each event is received from the event builder
+ * once, decoded once and passed to every configured monitor in turn.
+ */
+class MonitorHostModule : public MonitorBaseModule {
+ public:
+  MonitorHostModule(const std::string&);
+  ~MonitorHostModule();
+
+ protected:
+  // nothing to monitor itself: worker threads are possible if all hosted monitors support them
+  bool supportsWorkerThreads() const override { return true; }
+};
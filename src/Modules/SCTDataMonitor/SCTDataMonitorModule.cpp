@@ -45,7 +45,7 @@ void SCTDataMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) return;
 
-  if ( m_event->event_tag() != m_eventTag ) {
+  if ( m_event.event_tag() != m_eventTag ) {
     ERROR("Event tag does not match filter tag. Are the module's filter settings correct?");
     return;
   }
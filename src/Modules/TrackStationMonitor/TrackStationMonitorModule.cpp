@@ -73,20 +73,6 @@ double TrackStationMonitorModule::mse_fit(std::vector<Vector3> track, std::pair<
   return rms;
 }
 
-double TrackStationMonitorModule::mean(double* x, int n) {
-	double sum = 0;
-	for (int i = 0; i < n; i++)
-		sum += x[i];
-	return sum / n;
-}
-
-double TrackStationMonitorModule::rms(double* x, int n) {
-	double sum = 0;
-	for (int i = 0; i < n; i++)
-		sum += pow(x[i], 2);
-	return sqrt(sum / n);
-}
-
 
 TrackStationMonitorModule::TrackStationMonitorModule(const std::string& n) : MonitorBaseModule(n) { 
   INFO("");
@@ -131,16 +117,16 @@ void TrackStationMonitorModule::monitor(DataFragment<daqling::utilities::Binary>
   auto evtHeaderUnpackStatus = unpack_event_header(eventBuilderBinary);
   if (evtHeaderUnpackStatus) return;
 
-  if (m_event->event_tag() != m_eventTag) {
+  if (m_event.event_tag() != m_eventTag) {
     ERROR("Event tag does not match filter tag. Are the module's filter settings correct?");
     return;
   }
 
-  for(const auto &id :m_event->getFragmentIDs()) {
+  for(const auto &id :m_event.getFragmentIDs()) {
       if ((id&0xFFFF0000) != DAQFormats::TrackerSourceID) continue; 
       uint8_t trbId = id&0x0000000F;
       if (std::find(m_trb_ids.begin(), m_trb_ids.end(), trbId) == std::end(m_trb_ids)) continue;
-      const EventFragment* frag=m_event->find_fragment(id);
+      const FragmentView* frag=m_event.find_fragment(id);
       if (frag->payload_size() > kMAXFRAGSIZE) {
           WARNING("Large track fragment encountered for ID 0x"<<std::hex<<id<<std::dec<<" ("<<frag->payload_size()<<" bytes). Skipping event.");
           return;
@@ -153,15 +139,16 @@ void TrackStationMonitorModule::monitor(DataFragment<daqling::utilities::Binary>
     return;
   }
 
+  std::map<int, std::vector<SpacePoint>> spacepoints;
+
   for ( auto TRBBoardId : m_trb_ids ) {
 
     uint8_t LayerIdx = m_stationID == 0? (TRBBoardId-2)%kTRB_BOARDS : TRBBoardId%kTRB_BOARDS; // adjust for IFT
 
     try {
-      TrackerDataFragment trackerDataFragment = get_tracker_data_fragment(eventBuilderBinary, SourceIDs::TrackerSourceID + TRBBoardId);
-      m_eventId = trackerDataFragment.event_id();
+      const TrackerDataFragment& trackerDataFragment = get_tracker_data_fragment(eventBuilderBinary, SourceIDs::TrackerSourceID + TRBBoardId);
       if (LayerIdx == 0)
-        DEBUG("event " << m_eventId);
+        DEBUG("event " << trackerDataFragment.event_id());
 
       for (auto sctEvent : trackerDataFragment) {
         if (sctEvent == nullptr) {
@@ -254,13 +241,21 @@ void TrackStationMonitorModule::monitor(DataFragment<daqling::utilities::Binary>
 
               m_x = px;
               m_y = py;
-              m_x_vec[m_vec_idx] = px;
-              m_y_vec[m_vec_idx] = py;
-              m_vec_idx = (m_vec_idx+1) % kAVGSIZE;
+              {
+                std::lock_guard<std::mutex> lock(m_average_mutex);
+                m_x_moments.add_moving(px, kAVGSIZE);
+                m_y_moments.add_moving(py, kAVGSIZE);
+                mean_x = m_x_moments.mean;
+                mean_y = m_y_moments.mean;
+                rms_x = sqrt(m_x_moments.mean*m_x_moments.mean+m_x_moments.variance());
+                rms_y = sqrt(m_y_moments.mean*m_y_moments.mean+m_y_moments.variance());
+              }
+              m_histogrammanager->fill(m_prof_x, LayerIdx, px);
+              m_histogrammanager->fill(m_prof_y, LayerIdx, py);
 
               m_histogrammanager->fill2D(m_hit_maps[LayerIdx], px, py, 1);
-              m_spacepoints[LayerIdx].emplace_back(SpacePoint({px, py, kLAYERPOS[LayerIdx]}, cluster1.hitPatterns(), cluster2.hitPatterns()));
-              if (m_spacepoints[LayerIdx].size() > 10) {
+              spacepoints[LayerIdx].emplace_back(SpacePoint({px, py, kLAYERPOS[LayerIdx]}, cluster1.hitPatterns(), cluster2.hitPatterns()));
+              if (spacepoints[LayerIdx].size() > 10) {
                 break;
               }
             }
@@ -273,13 +268,13 @@ void TrackStationMonitorModule::monitor(DataFragment<daqling::utilities::Binary>
   }
 
   // calculate direction only for events with a space point in each layer
-  if (m_spacepoints.size() == 3) {
+  if (spacepoints.size() == 3) {
 
     // create all combinations of three space points
     std::vector<Tracklet> tracklets;
-    for (const auto& p0 : m_spacepoints[0]) {
-      for (const auto& p1 : m_spacepoints[1]) {
-        for (const auto& p2 : m_spacepoints[2]) {
+    for (const auto& p0 : spacepoints[0]) {
+      for (const auto& p1 : spacepoints[1]) {
+        for (const auto& p2 : spacepoints[2]) {
           tracklets.push_back(Tracklet(p0.position(), p1.position(), p2.position(), p0.hitPatterns(), p1.hitPatterns(), p2.hitPatterns()));
         }
       }
@@ -325,12 +320,6 @@ void TrackStationMonitorModule::monitor(DataFragment<daqling::utilities::Binary>
     }
   }
 
-  m_spacepoints.clear();
-
-  mean_x = mean(m_x_vec, kAVGSIZE);
-  mean_y = mean(m_y_vec, kAVGSIZE);
-  rms_x = rms(m_x_vec, kAVGSIZE);
-  rms_y = rms(m_y_vec, kAVGSIZE);
 }
 
 void TrackStationMonitorModule::register_hists() {
@@ -343,6 +332,8 @@ void TrackStationMonitorModule::register_hists() {
     m_histogrammanager->registerHistogram(hname_hitp, "hit pattern", m_hitp_categories, m_PUBINT);
   }
   m_histogrammanager->register2DHistogram("hitmap_track", "x", -kSTRIP_LENGTH, kSTRIP_LENGTH, 50, "y",  -kSTRIP_LENGTH, kSTRIP_LENGTH, 50, kPUBINT);
+  m_prof_x = m_histogrammanager->registerProfile("profile_x_layer", "layer", "mean x [mm]", -0.5, kLAYERS-0.5, kLAYERS, kPUBINT);
+  m_prof_y = m_histogrammanager->registerProfile("profile_y_layer", "layer", "mean y [mm]", -0.5, kLAYERS-0.5, kLAYERS, kPUBINT);
   m_histogrammanager->registerHistogram("x_track", "x_track", -128, 128, 25, kPUBINT);
   m_histogrammanager->registerHistogram("y_track", "y_track", -128, 128, 25, kPUBINT);
   m_histogrammanager->registerHistogram("phi_xz", "phi_xz", -5, 5, 100, kPUBINT);
@@ -7,6 +7,7 @@
 #include <Eigen/Dense>
 #include <vector>
 #include <map>
+#include <mutex>
 
 typedef Eigen::Matrix<double, 3, 1> Vector3;
 
@@ -19,6 +20,7 @@ class TrackStationMonitorModule : public MonitorBaseModule {
  protected:
 
   void monitor(DataFragment<daqling::utilities::Binary> &eventBuilderBinary);
+  bool supportsWorkerThreads() const override { return true; }
   void register_hists( );
   void register_metrics();
   std::atomic<float> m_x;
@@ -91,10 +93,7 @@ class TrackStationMonitorModule : public MonitorBaseModule {
   double intersection(double y1, double y2);
   std::pair<Vector3, Vector3> linear_fit(const std::vector<Vector3>& spacepoints);
   double mse_fit(std::vector<Vector3> track, std::pair<Vector3, Vector3> fit);
-  double mean(double* x, int n);
-  double rms(double* x, int n);
 
-  std::map<int, std::vector<SpacePoint>> m_spacepoints = {};
   uint8_t m_stationID = 0;
   const uint32_t kMAXFRAGSIZE=380; // max size in bytes for biggest TRB event fragment for track station to be analysed
   const std::string m_hit_maps[3] = {"hitmap_l0", "hitmap_l1", "hitmap_l2"};
@@ -103,22 +102,23 @@ class TrackStationMonitorModule : public MonitorBaseModule {
 
   double kLAYERPOS[3] = {16.2075, 47.7075, 79.2075}; // values in mm
   double kMODULEPOS[4] = {64.92386246, 1.20386696, -62.55613708, -126.25613403}; // values in mm
-  int m_vec_idx = 0;
-  static const int kAVGSIZE = 10000;
-  double m_x_vec[kAVGSIZE] = {0};
-  double m_y_vec[kAVGSIZE] = {0};
+  std::mutex m_average_mutex; // the moving moments are shared between workers
+  static const int kAVGSIZE = 10000; // space points averaged over
+  Moments m_x_moments;
+  Moments m_y_moments;
+  ProfileHandle m_prof_x;
+  ProfileHandle m_prof_y;
   const double kLAYER_OFFSET[3] = {0, -5, 5}; // in mm
   const double kSTRIP_PITCH = 0.08; // in mm
   const double kXMIN = -63.96; // in mm
   const double kXMAX = 63.96; // in mm
   const double kSTRIP_LENGTH = 126.08; // in mm
   const double kSTRIP_ANGLE = 0.04; // in radian
-  int m_eventId = 0;
   uint16_t m_bcid;
   uint32_t m_l1id;
   uint16_t number;
   uint16_t module;
-  unsigned m_total_WARNINGS;
+  std::atomic<unsigned> m_total_WARNINGS;
   bool m_print_WARNINGS;
   const uint8_t kLAYERS = 3;
   const uint8_t kTRB_BOARDS = 3;
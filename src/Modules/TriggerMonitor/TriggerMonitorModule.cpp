@@ -54,9 +54,9 @@ void TriggerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
     if ( m_bcid > MAX_BCID ) WARNING("Retrieved BCID number "<<m_bcid<<" exceeds max LHC range");
     m_orbitid = m_tlbdataFragment->orbit_id();
     m_l1A_spacing  = (double)((m_orbitid - m_previous_orbit)*MAX_BCID + std::copysign((m_bcid - m_previous_bcid)%MAX_BCID,  m_bcid - m_previous_bcid))/MAX_BCID;
-    m_histogrammanager->fill("bcid", m_bcid); 
+    m_histogrammanager->fill(m_hist_bcid, m_bcid); 
     if ( m_l1A_spacing < MAX_L1A_SPACING ) // protection for stretchy histograms
-      m_histogrammanager->fill("l1a_spacing", m_l1A_spacing); 
+      m_histogrammanager->fill(m_hist_l1a_spacing, m_l1A_spacing); 
     else
       WARNING("Computed L1A spacing beyond histogram range we've allowed.");
     m_previous_orbit = m_orbitid;
@@ -64,12 +64,12 @@ void TriggerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
     uint8_t inputs = m_tlbdataFragment->input_bits();
     uint8_t inputs_nextBC = m_tlbdataFragment->input_bits_next_clk();
     uint8_t tap = m_tlbdataFragment->tap();
-    m_histogrammanager->fill("trigitems_word", tap);
-    m_histogrammanager->fill("triglines_word", inputs);
-    m_histogrammanager->fill("triglines_word_bothClk", inputs|inputs_nextBC);
+    m_histogrammanager->fill(m_hist_trigitems_word, tap);
+    m_histogrammanager->fill(m_hist_triglines_word, inputs);
+    m_histogrammanager->fill(m_hist_triglines_word_bothClk, inputs|inputs_nextBC);
     for ( unsigned k = 0; k < MAX_TRIG_ITEMS; k++ ){
       if (tap & (1<<k)) {
-        m_histogrammanager->fill("trigitem_idx", k); 
+        m_histogrammanager->fill(m_hist_trigitem_idx, k); 
         switch (k){
           case 0: {m_tap0++; break;}
           case 1: {m_tap1++; break;}
@@ -79,8 +79,7 @@ void TriggerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
           case 5: {m_tap5++; break;}
           default: WARNING("trigger item "<<k<<" out of range.");
         }
-        std::string hname_bcid = "bcid_trig_"+std::to_string(k);
-        m_histogrammanager->fill(hname_bcid, m_bcid);
+        m_histogrammanager->fill(m_hist_bcid_trig[k], m_bcid);
       }
     }
     if (inputs) {
@@ -88,14 +87,14 @@ void TriggerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
         if (inputs & (1 << i )) {
           //std::string hname_signal_nextBC = m_prefix_hname_signal_nextBC+std::to_string(i);
           for ( unsigned j = 0; j < MAX_TRIG_LINES; j++ ){
-            if (inputs_nextBC & (1 << j )) m_histogrammanager->fill2D("signal_current_vs_nextBC", i, j);
+            if (inputs_nextBC & (1 << j )) m_histogrammanager->fill2D(m_hist_signal_current_vs_nextBC, i, j);
             if (j==i) continue;
-            if (inputs & (1 << j )) m_histogrammanager->fill2D("signal_currentBC", i, j);
+            if (inputs & (1 << j )) m_histogrammanager->fill2D(m_hist_signal_currentBC, i, j);
           }
           for ( unsigned k = 0; k < MAX_TRIG_ITEMS; k++ ){
-            if (tap & (1<<k)) m_histogrammanager->fill2D("trigline_vs_trigitem", i, k); 
+            if (tap & (1<<k)) m_histogrammanager->fill2D(m_hist_trigline_vs_trigitem, i, k); 
           }
-          m_histogrammanager->fill("trigline_idx", i);
+          m_histogrammanager->fill(m_hist_trigline_idx, i);
           switch (i){
             case 0: {m_input_channel0++; break;}
             case 1: {m_input_channel1++; break;}
@@ -110,7 +109,7 @@ void TriggerMonitorModule::monitor(DataFragment<daqling::utilities::Binary> &eve
         } // active bit on i
       } 
     }
-    if (inputs_nextBC && !isRndTrig) m_histogrammanager->fill("bcid_signalnextBC", m_bcid);
+    if (inputs_nextBC && !isRndTrig) m_histogrammanager->fill(m_hist_bcid_signalnextBC, m_bcid);
   }
   else WARNING("Skipping invalid trigger physics fragment:\n"<<std::dec<<*m_tlbdataFragment);
 }
@@ -121,23 +120,23 @@ void TriggerMonitorModule::register_hists() {
 
   const unsigned kPUBINT = 10; // larger interval than default
  
-  m_histogrammanager->registerHistogram("bcid", "BCID", -0.5, 4095.5, 4096, 60);
-  m_histogrammanager->registerHistogram("bcid_signalnextBC", "BCID", -0.5, 4095.5, 4096, kPUBINT);
-  m_histogrammanager->registerHistogram("l1a_spacing", "L1A Spacing [no. of orbits]", -0.5, 99.5, 500, Axis::Range::EXTENDABLE, 60);
-  m_histogrammanager->registerHistogram("trigline_idx", "Trigger Line Idx", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
-  m_histogrammanager->registerHistogram("trigitem_idx", "Trigger Item Idx", 0, MAX_TRIG_ITEMS, MAX_TRIG_ITEMS);
-  m_histogrammanager->registerHistogram("trigitems_word", "Trigger Item Word", 0, 16, 16);
-  m_histogrammanager->registerHistogram("triglines_word", "Trigger Line Word", 0, 256, 256);
-  m_histogrammanager->registerHistogram("triglines_word_bothClk", "Trigger Line Word", 0, 256, 256);
-  m_histogrammanager->register2DHistogram("signal_current_vs_nextBC", "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "active line next BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
-  m_histogrammanager->register2DHistogram("signal_currentBC", "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
-  m_histogrammanager->register2DHistogram("trigline_vs_trigitem", "trigger line", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "trigger item", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
+  m_hist_bcid = m_histogrammanager->registerHistogram("bcid", "BCID", -0.5, 4095.5, 4096, 60);
+  m_hist_bcid_signalnextBC = m_histogrammanager->registerHistogram("bcid_signalnextBC", "BCID", -0.5, 4095.5, 4096, kPUBINT);
+  m_hist_l1a_spacing = m_histogrammanager->registerHistogram("l1a_spacing", "L1A Spacing [no. of orbits]", -0.5, 99.5, 500, Axis::Range::EXTENDABLE, 60);
+  m_hist_trigline_idx = m_histogrammanager->registerHistogram("trigline_idx", "Trigger Line Idx", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
+  m_hist_trigitem_idx = m_histogrammanager->registerHistogram("trigitem_idx", "Trigger Item Idx", 0, MAX_TRIG_ITEMS, MAX_TRIG_ITEMS);
+  m_hist_trigitems_word = m_histogrammanager->registerHistogram("trigitems_word", "Trigger Item Word", 0, 16, 16);
+  m_hist_triglines_word = m_histogrammanager->registerHistogram("triglines_word", "Trigger Line Word", 0, 256, 256);
+  m_hist_triglines_word_bothClk = m_histogrammanager->registerHistogram("triglines_word_bothClk", "Trigger Line Word", 0, 256, 256);
+  m_hist_signal_current_vs_nextBC = m_histogrammanager->register2DHistogram("signal_current_vs_nextBC", "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "active line next BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
+  m_hist_signal_currentBC = m_histogrammanager->register2DHistogram("signal_currentBC", "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "active line current BC", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
+  m_hist_trigline_vs_trigitem = m_histogrammanager->register2DHistogram("trigline_vs_trigitem", "trigger line", 0, MAX_TRIG_LINES, MAX_TRIG_LINES, "trigger item", 0, MAX_TRIG_LINES, MAX_TRIG_LINES);
 
   // per trigger monitoring
   for ( unsigned t_item = 0; t_item < MAX_TRIG_ITEMS; t_item++) {
     std::string hname_bcid;
     hname_bcid = "bcid_trig_"+std::to_string(t_item);
-    m_histogrammanager->registerHistogram(hname_bcid, "BCID", -0.5, 4095.5, 4096, kPUBINT);
+    m_hist_bcid_trig[t_item] = m_histogrammanager->registerHistogram(hname_bcid, "BCID", -0.5, 4095.5, 4096, kPUBINT);
   }
 
   INFO(" ... done registering histograms ... " );
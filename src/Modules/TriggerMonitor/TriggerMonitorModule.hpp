@@ -43,4 +43,17 @@ class TriggerMonitorModule : public MonitorBaseModule {
    std::atomic<int> m_tap4;
    std::atomic<int> m_tap5;
 
+   Hist1DHandle m_hist_bcid;
+   Hist1DHandle m_hist_bcid_signalnextBC;
+   Hist1DHandle m_hist_l1a_spacing;
+   Hist1DHandle m_hist_trigline_idx;
+   Hist1DHandle m_hist_trigitem_idx;
+   Hist1DHandle m_hist_trigitems_word;
+   Hist1DHandle m_hist_triglines_word;
+   Hist1DHandle m_hist_triglines_word_bothClk;
+   Hist1DHandle m_hist_bcid_trig[6]; // per trigger item
+   Hist2DHandle m_hist_signal_current_vs_nextBC;
+   Hist2DHandle m_hist_signal_currentBC;
+   Hist2DHandle m_hist_trigline_vs_trigitem;
+
 };
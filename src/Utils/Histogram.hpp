@@ -10,7 +10,15 @@
 #include <iostream>
 #include <nlohmann/json.hpp> // dump Hist as json structure
 #include <algorithm> // std::fill
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <memory>
 #include <mutex>
+#include <numeric> // std::accumulate
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 using namespace boost::histogram;
 using json = nlohmann::json;
@@ -36,13 +44,144 @@ using hist2d_t = decltype(make_histogram(std::declval<axis_t>(), std::declval<ax
 using categoryaxis_t = axis::category<std::string>;
 using categoryhist_t = decltype(make_histogram(std::declval<categoryaxis_t>())); 
 
+namespace Storage {
+  /// Bin storage: ADAPTIVE grows the counter size as needed (boost's default), UINT32 holds integer
+  /// counts only (weights are truncated), SPARSE keeps only non-empty bins (2D histograms only)
+  enum Type{
+   ADAPTIVE=0,
+   UINT32=1,
+   SPARSE=2
+  };
+}
+using sparse_storage_t = storage_adaptor<std::unordered_map<std::size_t, double>>;
+using hist_u32_t = decltype(make_histogram_with(dense_storage<uint32_t>(), std::declval<axis_t>()));
+using hist2d_u32_t = decltype(make_histogram_with(dense_storage<uint32_t>(), std::declval<axis_t>(), std::declval<axis_t>()));
+using hist2d_sparse_t = decltype(make_histogram_with(sparse_storage_t(), std::declval<axis_t>(), std::declval<axis_t>()));
+
+/**
+ * Running count, mean and sum of squared deviations of values (Welford), as bins of profile
+ * histograms. Adding another set of moments combines them exactly (Chan et al.).
+ */
+struct Moments {
+  double n = 0;    // sum of weights
+  double mean = 0;
+  double m2 = 0;   // sum of weighted squared deviations from the mean
+  void operator()(const weight_type<double>& w, const double& y) { add(y, w.value); } // boost fills: always weighted
+  void add(double y, double w) {
+    n += w;
+    if (n == 0) return;
+    double delta = y-mean;
+    mean += delta*w/n;
+    m2 += w*delta*(y-mean);
+  }
+  /// Same as add(y, 1) until max_n values, then older values are weighted down exponentially:
+  /// a moving mean and variance over about the last max_n values, in constant time
+  void add_moving(double y, double max_n) {
+    if (n < max_n) n += 1;
+    else m2 *= (n-1)/n;
+    double delta = y-mean;
+    mean += delta/n;
+    m2 += delta*(y-mean);
+  }
+  Moments& operator+=(const Moments& other) {
+    if (other.n == 0) return *this;
+    double total = n+other.n;
+    double delta = other.mean-mean;
+    mean += delta*other.n/total;
+    m2 += other.m2+delta*delta*n*other.n/total;
+    n = total;
+    return *this;
+  }
+  bool operator==(const Moments& other) const { return n == other.n && mean == other.mean && m2 == other.m2; }
+  bool operator!=(const Moments& other) const { return !(*this == other); }
+  double variance() const { return n > 0 ? m2/n : 0; }
+  double spread() const { return std::sqrt(variance()); }
+};
+using profile_t = decltype(make_histogram_with(dense_storage<Moments>(), std::declval<axis_t>()));
+
+/// Approximate heap memory used by the bins of a histogram
+template <typename H>
+size_t storage_bytes(const H& h) {
+  const auto& storage = unsafe_access::storage(h);
+  using S = std::decay_t<decltype(storage)>;
+  if constexpr (std::is_same<S, unlimited_storage<>>::value) {
+    static const size_t cell_size[] = {1, 2, 4, 8, 16, 8}; // uint8 ... uint64, large int, double
+    const auto& buffer = unsafe_access::unlimited_storage_buffer(const_cast<S&>(storage));
+    return buffer.size*cell_size[buffer.type];
+  }
+  else if constexpr (std::is_same<S, sparse_storage_t>::value) {
+    const std::unordered_map<std::size_t, double>& map = unsafe_access::storage_adaptor_impl(const_cast<S&>(storage));
+    return map.size()*(sizeof(std::size_t)+sizeof(double)+2*sizeof(void*))+map.bucket_count()*sizeof(void*);
+  }
+  else return storage.size()*sizeof(typename S::value_type);
+}
+
+/// Adds the contents of from to to (same axes), visiting only filled bins of sparse storage
+template <typename H>
+void add_contents(H& to, H& from) {
+  if constexpr (std::is_same<typename H::storage_type, sparse_storage_t>::value) {
+    auto& to_storage = unsafe_access::storage(to);
+    const std::unordered_map<std::size_t, double>& filled = unsafe_access::storage_adaptor_impl(unsafe_access::storage(from));
+    for (const auto& bin : filled) to_storage[bin.first] += bin.second;
+  }
+  else to += from;
+}
+
+/**
+ * Contiguous array of values to fill in bulk, without copying: from a vector or pointer and size
+ */
+template <typename T>
+struct ValueSpan {
+  ValueSpan(const T* data, size_t size) : data(data), size(size) {}
+  ValueSpan(const std::vector<T>& values) : data(values.data()), size(values.size()) {}
+  const T* data;
+  size_t size;
+};
+
+/**
+ * Pair of histograms filled alternately: fills go to the active one without locking, the
+ * publisher swaps them and adds the one it took back into the published histogram.
+ * Each pair is filled by one thread at a time (the runner, or a worker through its shard).
+ */
+template <typename H>
+class FillBuffers {
+  public:
+  void init(const H& empty) { buffers[0] = empty; buffers[1] = empty; }
+  template <typename F>
+  void fill(F&& f) {
+    while (true) {
+      unsigned b = active.load();
+      users[b].fetch_add(1);
+      if (active.load() == b) { // not swapped before we announced ourselves
+        f(buffers[b]);
+        users[b].fetch_sub(1);
+        return;
+      }
+      users[b].fetch_sub(1);
+    }
+  }
+  /// Swaps buffers and passes the one filled so far to merge, then clears it. Callers serialise.
+  template <typename F>
+  void collect(F&& merge) {
+    unsigned b = active.load();
+    active.store(b^1);
+    while (users[b].load()) std::this_thread::yield(); // a fill in progress is a few ns
+    merge(buffers[b]);
+    buffers[b].reset();
+  }
+  private:
+  H buffers[2];
+  std::atomic<unsigned> active{0};
+  std::atomic<unsigned> users[2] = {{0}, {0}};
+};
+
 class HistBase {
   public:
   HistBase(){}
   HistBase(std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, bool extendable, float delta_t) : name(name), title(name), xlabel(xlabel), ylabel(ylabel), xmin(xmin), xmax(xmax), xbins(xbins), extendable(extendable), delta_t(delta_t) {timestamp = std::time(nullptr); json_object = json::object(); }
   HistBase(std::string name, std::string xlabel, std::string ylabel, unsigned int xbins, bool extendable, float delta_t) : name(name), title(name), xlabel(xlabel), ylabel(ylabel), xbins(xbins), extendable(extendable), delta_t(delta_t) { timestamp = std::time(nullptr); }
   virtual ~HistBase(){}
-  std::mutex m_hist_mutex; // prevent histogram access clashes
+  std::mutex m_hist_mutex; // serialises publish, merge and reset - fills do not take it
   //define hist
   std::string name, title, xlabel, ylabel;
   float xmin = -1.;
@@ -52,6 +191,11 @@ class HistBase {
   bool b_reset = false; // true: reset histogram entries to 0 after publish
   bool b_norm = false;  // true: normalise histogram by total entries at publish
   std::atomic<int>* norm_ptr = nullptr;
+  // with sampling: un-normalised contents are scaled up by the events received over those monitored since the last reset
+  const std::atomic<uint64_t>* received_ptr = nullptr;
+  const std::atomic<uint64_t>* sampled_ptr = nullptr;
+  uint64_t received_base = 0, sampled_base = 0; // guarded by m_hist_mutex
+  bool b_no_sampling_scale = false; // true: never scaled, e.g. the last event only
   //define published msg
   std::string type = "num_fixedwidth";
   std::ostringstream msg_head;
@@ -59,12 +203,197 @@ class HistBase {
   json json_object;
   std::time_t timestamp; 
   unsigned int delta_t;
+  Storage::Type storage = Storage::ADAPTIVE;
+  size_t memory = 0;       // bytes of bin storage, as last estimated
+  float publish_us = 0;    // time of the last publish
+  size_t publish_bytes = 0; // size of the last published message
+  std::string values_key = "yvalues"; // "zvalues" for 2D histograms
+  bool integer_values = false;          // bins published as integers in JSON
+  bool deltas = true;                   // false: changes are always published in full
+  //delta publishing: bins as last published and publishes since the last full one
+  std::vector<float> last_published;
+  unsigned since_keyframe = 0;
+  //per-thread copies filled in parallel, added to this histogram at publish (only their fill buffers are used)
+  std::vector<std::unique_ptr<HistBase>> shards;
+  /**
+   * Contents of the last `length` seconds only: the cumulative contents minus those of a ring of
+   * snapshots taken every `slice` seconds, published as <name>_<length>s without refilling.
+   */
+  struct TimeWindow {
+    std::string name;
+    unsigned length;
+    unsigned slice;
+    std::vector<std::vector<float>> snapshots; // empty: taken before anything was published
+    unsigned oldest = 0;
+    std::time_t next_slice = 0; // 0: start slicing at the next publish
+  };
+  std::vector<TimeWindow> windows;
   //public functions
-  virtual std::string publish() { return "nothing";}
+  /// Bin contents to publish (resets them if requested) and updates the axes in json_object
+  virtual std::vector<float> contents() { return {}; }
+  /// Estimated bin storage of the histogram, its fill buffers and shards
+  virtual size_t memory_bytes() { return 0; }
+  std::string publish() { return to_json(contents()); }
+  /// Same contents as publish(), in the compact binary format (see encode_binary)
+  std::string publish_binary() { return to_binary(contents()); }
+  std::string to_json(const std::vector<float>& values) {
+    set_values(json_object, values);
+    return json_object.dump();
+  }
+  std::string to_binary(const std::vector<float>& values) {
+    json_object.erase(values_key);
+    return encode_binary(json_object, values);
+  }
+  /// Changed bins only: the name, type, delta flag, bin indices and their new values
+  std::string to_delta(const std::vector<unsigned>& bins, const std::vector<float>& values, bool binary) const {
+    json delta = {{"name", name}, {"type", type}, {"delta", true}, {"bins", bins}};
+    if (json_object.contains("normalisation")) delta["normalisation"] = json_object["normalisation"];
+    if (binary) return encode_binary(delta, values);
+    set_values(delta, values);
+    return delta.dump();
+  }
+  /// Contents of a time window, with the axes of this histogram
+  std::string to_window(const TimeWindow& window, const std::vector<float>& values, bool binary) const {
+    json window_object = json_object;
+    window_object["name"] = window.name;
+    window_object.erase(values_key);
+    if (binary) return encode_binary(window_object, values);
+    set_values(window_object, values);
+    return window_object.dump();
+  }
+  /// Bin contents into a JSON message, as integers if the histogram counts and they are integral
+  void set_values(json& object, const std::vector<float>& values) const {
+    if (integer_values && std::all_of(values.begin(), values.end(), [](float v) { return v == std::floor(v); }))
+      object[values_key] = std::vector<int64_t>(values.begin(), values.end());
+    else object[values_key] = values;
+  }
   virtual void reset() {}
+  virtual std::unique_ptr<HistBase> make_shard() const { return nullptr; }
+  /// Moves everything filled since the last call (here and in the shards) into the published histogram
+  virtual void merge_shards() {}
+  HistBase* fill_target(int shard) { return (shard>=0 && shard<(int)shards.size()) ? shards[shard].get() : this; }
   void reset_on_publish(bool reset=true){ b_reset=reset;}
   void normalise_on_publish(bool norm=true){ b_norm=norm;}
   void set_normalisation_metric(std::atomic<int>* ptr){ norm_ptr=ptr;}
+  void no_sampling_scale(bool no_scale=true){ b_no_sampling_scale=no_scale;}
+  void set_sampling_counters(const std::atomic<uint64_t>* received, const std::atomic<uint64_t>* sampled){
+    std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+    received_ptr=received;
+    sampled_ptr=sampled;
+    restart_sampling();
+  }
+  protected:
+  /// Starts counting received and monitored events anew, when the contents are reset (with m_hist_mutex held)
+  void restart_sampling(){
+    if (!received_ptr || !sampled_ptr) return;
+    sampled_base=*sampled_ptr;
+    received_base=*received_ptr;
+  }
+  public:
+  /**
+   * Binary publication: uint8 version, uint8 bin encoding, uint16 schema length, schema (the JSON
+   * message without the bin contents), uint32 number of bins, bin contents. Bins are unsigned LEB128
+   * varints if all are non-negative integers (encoding 1), otherwise float32 (encoding 0).
+   * All integers are little endian. Decoded by scripts/Web/histogramDecoder.py.
+   */
+  static std::string encode_binary(const json& schema, const std::vector<float>& values) {
+    static constexpr uint8_t version = 1;
+    bool varint = std::all_of(values.begin(), values.end(), [](float v) { return v >= 0 && v < 4294967296.f && v == std::floor(v); });
+    std::string head = schema.dump();
+    uint16_t head_size = head.size();
+    uint32_t nvalues = values.size();
+    std::string msg;
+    msg.reserve(8+head.size()+values.size()*sizeof(float));
+    msg.push_back(version);
+    msg.push_back(varint ? 1 : 0);
+    msg.append(reinterpret_cast<const char*>(&head_size), sizeof(head_size));
+    msg.append(head, 0, head_size);
+    msg.append(reinterpret_cast<const char*>(&nvalues), sizeof(nvalues));
+    if (varint) {
+      for (float v : values) {
+        uint32_t value = v;
+        while (value >= 0x80) { msg.push_back(static_cast<char>(value | 0x80)); value >>= 7; }
+        msg.push_back(static_cast<char>(value));
+      }
+    }
+    else msg.append(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(float));
+    return msg;
+  }
+  /// Inverse of encode_binary, returns false if the message is truncated or of an unknown version
+  static bool decode_binary(const char* data, size_t size, json& schema, std::vector<float>& values) {
+    if (size < 4 || data[0] != 1) return false;
+    uint8_t encoding = data[1];
+    uint16_t head_size;
+    std::memcpy(&head_size, data+2, sizeof(head_size));
+    size_t pos = 4+head_size;
+    if (size < pos+4) return false;
+    schema = json::parse(data+4, data+pos, nullptr, false);
+    if (schema.is_discarded()) return false;
+    uint32_t nvalues;
+    std::memcpy(&nvalues, data+pos, sizeof(nvalues));
+    pos += sizeof(nvalues);
+    values.clear();
+    if (encoding == 0) {
+      if (size-pos < nvalues*sizeof(float)) return false;
+      values.resize(nvalues);
+      std::memcpy(values.data(), data+pos, nvalues*sizeof(float));
+      return true;
+    }
+    if (encoding != 1) return false;
+    values.reserve(nvalues);
+    uint32_t value = 0;
+    unsigned shift = 0;
+    for (; pos < size; pos++) {
+      uint8_t byte = data[pos];
+      value |= uint32_t(byte & 0x7f) << shift;
+      if (byte & 0x80) shift += 7;
+      else {
+        values.push_back(value);
+        value = 0;
+        shift = 0;
+      }
+    }
+    return values.size() == nvalues;
+  }
+  protected:
+  /**
+   * Bin contents as published: normalised, or scaled up for the events not monitored.
+   * Normalised contents carry the count divided by as "normalisation", to combine them.
+   */
+  template <typename V, typename H, typename C>
+  std::vector<V> scaled_contents(const H& hist_object, C cov) {
+      std::vector<V> values;
+      float weight(1);
+      if (b_norm) {
+          double normalisation = 1;
+          if (norm_ptr != nullptr) {
+              if (*norm_ptr > 0) normalisation = *norm_ptr;
+          }
+          else {
+              unsigned total_entries = std::accumulate(hist_object.begin(), hist_object.end(), 0.0);
+              if (total_entries > 0) normalisation = total_entries;
+          }
+          weight = 1./normalisation;
+          json_object["normalisation"] = normalisation;
+      }
+      else {
+          json_object.erase("normalisation");
+          if (!b_no_sampling_scale && received_ptr != nullptr && sampled_ptr != nullptr) {
+              uint64_t sampled = *sampled_ptr-sampled_base;
+              uint64_t received = *received_ptr-received_base;
+              if (sampled > 0 && received > sampled) weight = double(received)/sampled;
+          }
+      }
+      values.reserve(hist_object.size());
+      if (cov == coverage::all) { // same order as indexed(), without its per bin index bookkeeping
+        for (auto y : hist_object) values.push_back(y*weight);
+        return values;
+      }
+      for (auto y : indexed(hist_object, cov ) ) {
+            values.push_back((*y)*weight);
+      }
+      return values;
+  }
 };
 
 
@@ -78,55 +407,103 @@ class Hist : public HistBase {
   ~Hist(){}
   template <typename X, typename W>
   void fill(X x, W w = 1)  { 
-      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-      hist_object(x, weight(w));
+      fill_buffers.fill([&](T& h) { h(x, weight(w)); });
       }
-  std::string publish() {
+  /// Fills n entries at once: values x[i] with weights w[i]
+  template <typename X, typename W>
+  void fill_n(const X* x, const W* w, size_t n) {
+      fill_buffers.fill([&](T& h) {
+        for (size_t i = 0; i < n; i += kBlock) fill_block(h, x+i, w+i, std::min(kBlock, n-i));
+      });
+  }
+  /// Fills n entries at once: values start+i*step with weights w[i], e.g. a sampled pulse
+  template <typename X, typename W>
+  void fill_n(X start, X step, const W* w, size_t n) {
+      fill_buffers.fill([&](T& h) {
+        X x[kBlock];
+        for (size_t i = 0; i < n; i += kBlock) {
+          size_t block = std::min(kBlock, n-i);
+          for (size_t j = 0; j < block; j++) x[j] = start+(i+j)*step;
+          fill_block(h, x, w+i, block);
+        }
+      });
+  }
+  std::vector<float> contents() override {
       std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-      auto this_axis = hist_object.axis();
-      std::vector<int> yvalues;
-      float weight(1);
-      if (b_norm) {
-          if (norm_ptr != nullptr) {
-              *norm_ptr > 0 ? weight = 1./(*norm_ptr) : 1;
-          }
-          else {
-              unsigned total_entries = std::accumulate(hist_object.begin(), hist_object.end(), 0.0);
-              total_entries > 0 ? weight = 1./total_entries : 1;
-          }
-      }
-      for (auto y : indexed(hist_object, coverage::all ) ) {
-            yvalues.push_back((*y)*weight);
-      }
-      json jsonupdate;
       if (extendable) {
         unsigned int xbins_new = hist_object.axis().size();
-        jsonupdate["xbins"] = xbins_new;
-        jsonupdate["xmin"] = hist_object.axis().bin(0).lower(); 
-        jsonupdate["xmax"] = hist_object.axis().bin(xbins_new-1).upper(); 
+        json_object["xbins"] = xbins_new;
+        json_object["xmin"] = hist_object.axis().bin(0).lower(); 
+        json_object["xmax"] = hist_object.axis().bin(xbins_new-1).upper(); 
       }
-      jsonupdate["yvalues"] = yvalues;
-      json_object.update(jsonupdate);
+      auto yvalues = scaled_contents<float>(hist_object, coverage::all);
       if (b_reset) {
        //auto ind = indexed(hist_object, coverage::all);
        std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+       restart_sampling();
       }
-      return json_object.dump();
+      return yvalues;
   }
   void reset(){
        std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+       collect();
        std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+       restart_sampling();
+  }
+  std::unique_ptr<HistBase> make_shard() const override {
+      return std::make_unique<Hist<T>>(name, xlabel, ylabel, xmin, xmax, xbins, extendable, delta_t);
+  }
+  void merge_shards() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+  }
+  size_t memory_bytes() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      return storage_bytes(hist_object)*3*(1+shards.size()); // fill buffers hold at most as much
   }
   private:
   T hist_object;
+  FillBuffers<T> fill_buffers;
+  static constexpr size_t kBlock = 64;
+  template <typename X, typename W>
+  static void fill_block(T& h, const X* x, const W* w, size_t n) {
+      if constexpr (std::is_same<T, hist_t>::value || std::is_same<T, hist_u32_t>::value) {
+        // fixed regular axis: all bin indices first (vectorisable), then accumulate into the storage
+        int bins[kBlock];
+        const auto& axis = h.axis();
+        for (size_t i = 0; i < n; i++) bins[i] = axis.index(x[i])+1; // storage starts with the underflow bin
+        auto storage = h.begin();
+        for (size_t i = 0; i < n; i++) storage[bins[i]] += w[i];
+      }
+      else {
+        for (size_t i = 0; i < n; i++) h(x[i], weight(w[i]));
+      }
+  }
+  void collect() {
+      auto merge = [this](T& filled) {
+        if (extendable) { // axes may have grown differently, so refill at bin centres
+          for (auto&& bin : indexed(filled)) {
+            double content = *bin;
+            if (content != 0) hist_object(bin.bin().center(), weight(content));
+          }
+        }
+        else hist_object += filled;
+      };
+      fill_buffers.collect(merge);
+      for (auto& shard : shards) static_cast<Hist<T>*>(shard.get())->fill_buffers.collect(merge);
+  }
   void configure() {
-    if (extendable){
+    integer_values = true;
+    if constexpr (std::is_same<T, stretchy_hist_t>::value) {
       hist_object = make_histogram(stretchy_axis_t(xbins, xmin, xmax, xlabel));
+      fill_buffers.init(hist_object);
       type.append("_ext");
       set_base_info(); 
     }
     else {
-      hist_object = make_histogram(axis_t(xbins, xmin, xmax, xlabel));
+      hist_object = make_histogram_with(typename T::storage_type(), axis_t(xbins, xmin, xmax, xlabel));
+      if (std::is_same<T, hist_u32_t>::value) storage = Storage::UINT32;
+      fill_buffers.init(hist_object);
       set_base_info(); 
     }
   }
@@ -149,51 +526,61 @@ class CategoryHist : public HistBase { // this hist object is of special type: f
   }
   ~CategoryHist(){}
   template <typename W>
-  void fill(std::string x, W w = 1)  {
-    std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-    hist_object(x, weight(w));
+  void fill(const std::string& x, W w = 1)  {
+    fill_buffers.fill([&](categoryhist_t& h) { h(x, weight(w)); });
   }
   template <typename W>
   void fill(const char * x, W w = 1)  { 
-    std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-    hist_object(x, weight(w));
+    fill_buffers.fill([&](categoryhist_t& h) { h(x, weight(w)); });
+  }
+  // bin of a category (the overflow bin if unknown), to fill repeatedly without looking up the string
+  int bin(const std::string& x) const {
+    return hist_object.axis().index(x);
   }
-  std::string publish() override {
+  template <typename W>
+  void fill_bin(int bin, W w = 1)  {
+    fill_buffers.fill([&](categoryhist_t& h) { h.at(bin) += w; });
+  }
+  std::vector<float> contents() override {
       std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-      auto this_axis = hist_object.axis();
-      std::vector<float> yvalues;
-      float weight(1);
-      if (b_norm) {
-          if (norm_ptr != nullptr) {
-              *norm_ptr > 0 ? weight = 1./(*norm_ptr) : 1;
-          }
-          else {
-              unsigned total_entries = std::accumulate(hist_object.begin(), hist_object.end(), 0.0);
-              total_entries > 0 ? weight = 1./total_entries : 1;
-          }
-      }
-      for (auto y : indexed(hist_object, coverage::inner ) ) { // no under/overflows for boost hist objects of axis type category.
-            yvalues.push_back((*y)*weight);
-      }
-      json jsonupdate;
-      jsonupdate["yvalues"] = yvalues;
-      json_object.update(jsonupdate);
+      auto yvalues = scaled_contents<float>(hist_object, coverage::inner); // no under/overflows for boost hist objects of axis type category.
       if (b_reset) {
        //auto ind = indexed(hist_object, coverage::all);
        std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+       restart_sampling();
       }
-      return json_object.dump();
+      return yvalues;
   }
   void reset(){
        std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+       collect();
        std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+       restart_sampling();
+  }
+  std::unique_ptr<HistBase> make_shard() const override {
+      return std::make_unique<CategoryHist>(name, xlabel, ylabel, categories, delta_t);
+  }
+  void merge_shards() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+  }
+  size_t memory_bytes() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      return storage_bytes(hist_object)*3*(1+shards.size());
   }
   private:
   categoryhist_t hist_object;
+  FillBuffers<categoryhist_t> fill_buffers;
+  void collect() {
+      auto merge = [this](categoryhist_t& filled) { hist_object += filled; };
+      fill_buffers.collect(merge);
+      for (auto& shard : shards) static_cast<CategoryHist*>(shard.get())->fill_buffers.collect(merge);
+  }
   std::vector<std::string> categories;
    void configure() {
       categoryaxis_t category_axis = categoryaxis_t(categories); 
       hist_object = make_histogram(category_axis);
+      fill_buffers.init(hist_object);
       type = "categories";
       set_base_info();
   }
@@ -214,6 +601,7 @@ class CategoryHist : public HistBase { // this hist object is of special type: f
   }
 };
 
+template <typename T = hist2d_t>
 class Hist2D : public HistBase {
   public:
   Hist2D() : HistBase(){}
@@ -226,44 +614,49 @@ class Hist2D : public HistBase {
   float ybins;
   template <typename X, typename Y, typename W>
   void fill( X x, Y y, W w=1) { 
-      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-      hist_object(x,y, weight(w));
+      fill_buffers.fill([&](T& h) { h(x,y, weight(w)); });
       }
-  std::string publish() {
+  std::vector<float> contents() override {
       std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-      auto this_axis = hist_object.axis();
-      std::vector<float> zvalues;
-      float weight(1);
-      if (b_norm) {
-          if (norm_ptr != nullptr) {
-              *norm_ptr > 0 ? weight = 1./(*norm_ptr) : 1;
-          }
-          else {
-              unsigned total_entries = std::accumulate(hist_object.begin(), hist_object.end(), 0.0);
-              total_entries > 0 ? weight = 1./total_entries : 1;
-          }
-      }
-      for (auto z : indexed(hist_object, coverage::all ) ) {
-            zvalues.push_back((*z)*weight);
-      }
-      json jsonupdate;
-      jsonupdate["zvalues"] = zvalues;
-      json_object.update(jsonupdate);
+      auto zvalues = scaled_contents<float>(hist_object, coverage::all);
       if (b_reset) {
-       //auto ind = indexed(hist_object, coverage::all);
-       std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+        hist_object.reset();
+        restart_sampling();
       }
-      return json_object.dump();
+      return zvalues;
   }
   void reset(){
        std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
-       std::fill(hist_object.begin(), hist_object.end(), 0); // FIXME: This might break with boost version > 1.70
+       collect();
+       hist_object.reset();
+       restart_sampling();
+  }
+  std::unique_ptr<HistBase> make_shard() const override {
+      return std::make_unique<Hist2D<T>>(name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, delta_t);
+  }
+  void merge_shards() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+  }
+  size_t memory_bytes() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      return storage_bytes(hist_object)*3*(1+shards.size()); // fill buffers hold at most as much
   }
   private:
-  hist2d_t hist_object;
+  T hist_object;
+  FillBuffers<T> fill_buffers;
+  void collect() {
+      auto merge = [this](T& filled) { add_contents(hist_object, filled); };
+      fill_buffers.collect(merge);
+      for (auto& shard : shards) static_cast<Hist2D<T>*>(shard.get())->fill_buffers.collect(merge);
+  }
   void configure() {
-      hist_object = make_histogram(axis_t(xbins, xmin, xmax, xlabel), axis_t(ybins, ymin, ymax, ylabel));
+      hist_object = make_histogram_with(typename T::storage_type(), axis_t(xbins, xmin, xmax, xlabel), axis_t(ybins, ymin, ymax, ylabel));
+      if (std::is_same<T, hist2d_u32_t>::value) storage = Storage::UINT32;
+      if (std::is_same<T, hist2d_sparse_t>::value) storage = Storage::SPARSE;
+      fill_buffers.init(hist_object);
       type="2d_num_fixedwidth";
+      values_key="zvalues";
       set_base_info(); 
   }
   void set_base_info(){
@@ -280,3 +673,159 @@ class Hist2D : public HistBase {
   }
 };
 
+/// Sum of the values and weights filled into a trend since it was last collected
+struct TrendSum {
+  double sum = 0;
+  double weight = 0;
+  void reset() { sum = 0; weight = 0; }
+};
+
+/**
+ * Trend of a scalar such as a pedestal mean: the weighted mean of the values filled in each
+ * `interval` seconds, for the last xbins intervals. Published as a 1D histogram over the time
+ * before publishing, with the latest point in the last bin. Intervals without fills repeat the
+ * previous point. Points are closed at publish, so interval should be a multiple of delta_t.
+ */
+class TrendHist : public HistBase {
+  public:
+  TrendHist(std::string name, std::string ylabel, unsigned int points, unsigned int interval, float delta_t) : HistBase(name, "time [s]", ylabel, -float(points*interval), 0., points, false, delta_t), interval(interval), points(points, 0.f) {
+     configure();
+  }
+  ~TrendHist(){}
+  void fill(double x, double w = 1) {
+      fill_buffers.fill([&](TrendSum& s) { s.sum += x*w; s.weight += w; });
+  }
+  std::vector<float> contents() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+      std::time_t now = std::time(nullptr);
+      if (now-next_point >= std::time_t(points.size()*interval)) next_point = now-points.size()*interval; // long gap: only the last points matter
+      while (now >= next_point) {
+        if (current.weight != 0) last = current.sum/current.weight;
+        current.reset();
+        points[oldest] = last;
+        oldest = (oldest+1)%points.size();
+        next_point += interval;
+      }
+      std::vector<float> values;
+      values.reserve(points.size()+2);
+      values.push_back(0); // same layout as fixed axis histograms: underflow, bins, overflow
+      for (unsigned ii = 0; ii < points.size(); ii++) values.push_back(points[(oldest+ii)%points.size()]);
+      values.push_back(0);
+      return values;
+  }
+  void reset() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+      current.reset();
+      std::fill(points.begin(), points.end(), 0.f);
+      last = 0;
+      next_point = std::time(nullptr)+interval;
+  }
+  std::unique_ptr<HistBase> make_shard() const override {
+      return std::make_unique<TrendHist>(name, ylabel, points.size(), interval, delta_t);
+  }
+  void merge_shards() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+  }
+  size_t memory_bytes() override {
+      return points.size()*sizeof(float);
+  }
+  private:
+  unsigned int interval; // in s
+  std::vector<float> points; // ring of interval means, newest overwrites the oldest
+  unsigned int oldest = 0; // overwritten by the next point
+  float last = 0;
+  TrendSum current;
+  std::time_t next_point;
+  FillBuffers<TrendSum> fill_buffers;
+  void collect() {
+      auto merge = [this](TrendSum& filled) { current.sum += filled.sum; current.weight += filled.weight; };
+      fill_buffers.collect(merge);
+      for (auto& shard : shards) static_cast<TrendHist*>(shard.get())->fill_buffers.collect(merge);
+  }
+  void configure() {
+      fill_buffers.init(TrendSum());
+      next_point = std::time(nullptr)+interval;
+      type = "trend";
+      json_object["name"]=name;
+      json_object["type"]=type;
+      json_object["xlabel"]=xlabel;
+      json_object["ylabel"]=ylabel;
+      json_object["xbins"]=xbins;
+      json_object["xmin"]=xmin;
+      json_object["xmax"]=xmax;
+  }
+};
+
+/**
+ * Profile histogram: the mean of the values y filled in each bin of a fixed x axis, e.g. the mean
+ * pedestal per channel, from running moments per bin. Published as a 1D histogram of the means
+ * (with underflow and overflow bins), with the "spread" (standard deviation) and "entries"
+ * (sum of weights) of each bin in the header.
+ */
+class ProfileHist : public HistBase {
+  public:
+  ProfileHist(std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, float delta_t) : HistBase(name, xlabel, ylabel, xmin, xmax, xbins, false, delta_t) {
+     configure();
+  }
+  ~ProfileHist(){}
+  template <typename X, typename Y, typename W>
+  void fill(X x, Y y, W w = 1) {
+      fill_buffers.fill([&](profile_t& h) { h(x, weight(double(w)), sample(double(y))); });
+  }
+  std::vector<float> contents() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      std::vector<float> means, spreads, entries;
+      means.reserve(hist_object.size());
+      spreads.reserve(hist_object.size());
+      entries.reserve(hist_object.size());
+      for (const auto& bin : hist_object) {
+        means.push_back(bin.mean);
+        spreads.push_back(bin.spread());
+        entries.push_back(bin.n);
+      }
+      json_object["spread"] = spreads;
+      json_object["entries"] = entries;
+      if (b_reset) hist_object.reset();
+      return means;
+  }
+  void reset() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+      hist_object.reset();
+  }
+  std::unique_ptr<HistBase> make_shard() const override {
+      return std::make_unique<ProfileHist>(name, xlabel, ylabel, xmin, xmax, xbins, delta_t);
+  }
+  void merge_shards() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      collect();
+  }
+  size_t memory_bytes() override {
+      std::lock_guard<std::mutex> lock_guard(m_hist_mutex);
+      return storage_bytes(hist_object)*3*(1+shards.size());
+  }
+  private:
+  profile_t hist_object;
+  FillBuffers<profile_t> fill_buffers;
+  void collect() {
+      auto merge = [this](profile_t& filled) { hist_object += filled; };
+      fill_buffers.collect(merge);
+      for (auto& shard : shards) static_cast<ProfileHist*>(shard.get())->fill_buffers.collect(merge);
+  }
+  void configure() {
+      hist_object = make_histogram_with(dense_storage<Moments>(), axis_t(xbins, xmin, xmax, xlabel));
+      fill_buffers.init(hist_object);
+      type = "profile";
+      deltas = false; // the spreads and entries are not part of deltas
+      json_object["name"]=name;
+      json_object["type"]=type;
+      json_object["xlabel"]=xlabel;
+      json_object["ylabel"]=ylabel;
+      json_object["xbins"]=xbins;
+      json_object["xmin"]=xmin;
+      json_object["xmax"]=xmax;
+  }
+};
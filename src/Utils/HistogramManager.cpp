@@ -2,12 +2,20 @@
   Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
 */
 #include "HistogramManager.hpp"
+#include "HistogramMessage.hpp"
+#include <cstring>
+#include <queue>
 #include <type_traits>
 #include <typeinfo>
 
-HistogramManager::HistogramManager() {
+thread_local int HistogramManager::m_thread_shard = -1;
+
+HistogramManager::HistogramManager() : HistogramManager(daqling::core::Configuration::instance().getName()) {
+}
+
+HistogramManager::HistogramManager(const std::string& name) {
   m_zmq_publisher = false;  
-  m_name = m_config.getName();
+  m_name = name;
 }
 
 
@@ -33,6 +41,15 @@ void HistogramManager::configure(uint8_t ioT, std::string connStr, unsigned inte
   }
 }
 
+void HistogramManager::connect(std::string connStr) {
+  try {
+    m_histo_socket->connect(connStr);
+    INFO(" Histograms are also published on: " << connStr);
+  } catch (std::exception &e) {
+    throw FailedToAddZMQChannel(ERS_HERE,e.what());
+  }
+}
+
 void HistogramManager::start(){
 
   INFO("HistogramManager thread about to spawn...");
@@ -45,12 +62,17 @@ void HistogramManager::start(){
 void HistogramManager::stop(){
 
   INFO("HistogramManager shutting down ...");
-  m_stop_thread = true;
+  {
+    std::lock_guard<std::mutex> lock(m_stop_mutex);
+    m_stop_thread = true;
+  }
+  m_stop_cv.notify_all();
   if (m_histogram_thread.joinable())
     m_histogram_thread.join();
 
   INFO("Flushing all histograms ...");
   flushHistograms();
+  report();
 
   // m_histo_socket.reset();
   // m_histo_context.reset();
@@ -59,16 +81,49 @@ void HistogramManager::stop(){
   return;
 }
 
+/***
+\brief: publishes each histogram every delta_t seconds, earliest deadline first, sleeping until the
+next one is due. Histograms with the same interval are spread evenly over it rather than published
+in one burst. Histograms added while running are first published one interval after registration.
+***/
 void HistogramManager::CheckHistograms(){
 
+  using clock = std::chrono::steady_clock;
+  using Deadline = std::pair<clock::time_point, HistBase *>;
+  auto later = [](const Deadline& a, const Deadline& b) { return a.first > b.first; };
+  std::priority_queue<Deadline, std::vector<Deadline>, decltype(later)> schedule(later);
+
+  std::unique_lock<std::mutex> lock(m_stop_mutex);
+  m_unscheduled.clear(); // everything in the map is scheduled here
+  std::map<unsigned, unsigned> per_interval, scheduled;
+  for (auto &pair : m_histogram_map ) per_interval[pair.second->delta_t]++;
+  auto now = clock::now();
+  for (auto &pair : m_histogram_map ) {
+    HistBase * x = pair.second;
+    std::chrono::milliseconds period(x->delta_t*1000);
+    schedule.push({now+period*(++scheduled[x->delta_t])/per_interval[x->delta_t], x});
+  }
+
+  auto wake = [this] { return m_stop_thread.load() || !m_unscheduled.empty(); };
   while(!m_stop_thread){
-    for (auto &pair : m_histogram_map ) { 
-      HistBase * x = pair.second;
-      if(std::difftime(std::time(nullptr), x->timestamp) >= x->delta_t){
-            publish(x);
-      }
+    now = clock::now();
+    for (HistBase * x : m_unscheduled) schedule.push({now+std::chrono::milliseconds(x->delta_t*1000), x});
+    m_unscheduled.clear();
+    if (schedule.empty()) {
+      m_stop_cv.wait(lock, wake);
+      continue;
     }
-    std::this_thread::sleep_for(std::chrono::milliseconds(m_interval));
+    Deadline next = schedule.top();
+    if (m_stop_cv.wait_until(lock, next.first, wake)) continue;
+    schedule.pop();
+    lock.unlock();
+    publish(next.second);
+    lock.lock();
+    std::chrono::milliseconds period(next.second->delta_t*1000);
+    auto due = next.first+period;
+    now = clock::now();
+    if (due < now) due = now+period; // fell behind: do not publish in a burst to catch up
+    schedule.push({due, next.second});
   }
 }
 
@@ -77,29 +132,149 @@ void HistogramManager::CheckHistograms(){
 ***/
 void HistogramManager::flushHistograms(){
 
+  std::lock_guard<std::mutex> lock(m_stop_mutex);
   for (auto &pair : m_histogram_map ) { 
     HistBase * x = pair.second;
-    publish(x);
-    reset(pair.first);
+    publish(x, true);
+    reset(x);
+    x->last_published.clear(); // start the next run with a full publish
   }
 
 }
 
 void HistogramManager::publish( HistBase * h){
+  publish(h, false);
+}
 
-  std::ostringstream msg;
-  msg<<m_name+"-h_"+h->name<<": "<<h->publish();
-  DEBUG("START_OF_MSG:" <<std::endl << msg.str());
+void HistogramManager::publish( HistBase * h, bool full){
+
+  auto t0 = std::chrono::steady_clock::now();
+  h->merge_shards();
+  h->timestamp = std::time(nullptr);
+  auto values = h->contents();
+  size_t memory = h->memory_bytes();
+  m_stats.memory += memory-h->memory; // wraps around correctly when shrinking
+  h->memory = memory;
+  publishWindows(h, values); // before skipping unchanged contents: old entries leave the windows
+
+  // with keyframes: compare to what was last published, send only changed bins
+  std::vector<unsigned> changed;
+  bool keyframe = true;
+  if (m_keyframe_interval) {
+    keyframe = full || ++h->since_keyframe >= m_keyframe_interval || values.size() != h->last_published.size();
+    if (!keyframe) {
+      for (unsigned bin = 0; bin < values.size(); bin++)
+        if (values[bin] != h->last_published[bin]) changed.push_back(bin);
+      if (changed.empty()) {
+        m_stats.skipped++;
+        m_stats.time_us = (m_publish_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count())/1000;
+        return;
+      }
+      keyframe = !h->deltas || changed.size()*3 > values.size(); // indices and values: not worth it when dense
+    }
+    if (keyframe) h->since_keyframe = 0;
+  }
+
+  std::string body;
+  if (keyframe) {
+    body = m_binary_format ? h->to_binary(values) : h->to_json(values);
+    m_stats.full++;
+  }
+  else {
+    std::vector<float> changed_values;
+    changed_values.reserve(changed.size());
+    for (auto bin : changed) changed_values.push_back(values[bin]);
+    body = h->to_delta(changed, changed_values, m_binary_format);
+    m_stats.deltas++;
+  }
+  if (m_keyframe_interval) h->last_published = std::move(values);
+
+  h->publish_bytes = send(h, h->name, body);
+  auto elapsed = std::chrono::steady_clock::now()-t0;
+  h->publish_us = std::chrono::duration<float,std::micro>(elapsed).count();
+  m_stats.time_us = (m_publish_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count())/1000;
+ 
+  return;
+}
+
+/***
+\brief: sends '<module>-h[b][z]_<name>: <body>', with the body compressed if it is at least the
+compression threshold and compression makes it smaller. Returns the message size.
+***/
+size_t HistogramManager::send( HistBase * h, const std::string& name, const std::string& body){
+  const std::string * payload = &body;
+  bool compressed = false;
+  if (m_compression_threshold && body.size() >= m_compression_threshold) {
+    auto t0 = std::chrono::steady_clock::now();
+    compressed = HistogramMessage::compress_body(body, m_compressed) && m_compressed.size() < body.size();
+    m_stats.compress_us = (m_compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-t0).count())/1000;
+    if (compressed) {
+      payload = &m_compressed;
+      m_raw_bytes += body.size();
+      m_compressed_bytes += m_compressed.size();
+      m_stats.compressed++;
+      m_stats.compression_ratio = float(m_raw_bytes)/m_compressed_bytes;
+    }
+  }
+  std::string header = m_name+"-h"+(m_binary_format ? "b" : "")+(compressed ? "z" : "")+"_"+name+": ";
+  if (m_binary_format || compressed) DEBUG("Histogram message "<<header<<payload->size()<<" bytes");
+  else DEBUG("START_OF_MSG:" <<std::endl << header << body);
+
+  size_t size = header.size()+payload->size();
   if(m_zmq_publisher){
-     zmq::message_t message(msg.str().size());
-     memcpy (message.data(), msg.str().data(), msg.str().size());
+     zmq::message_t message(size);
+     std::memcpy(message.data(), header.data(), header.size());
+     std::memcpy(static_cast<char*>(message.data())+header.size(), payload->data(), payload->size());
      bool rc = m_histo_socket->send(message);
      if(!rc)
         WARNING("Failed to publish histogram with name "<<h->name);
+     else
+        m_stats.bytes += size;
    }
-  h->timestamp = std::time(nullptr);
- 
-  return;
+  return size;
+}
+
+/***
+\brief: publishes the time windows of a histogram. At the start of each slice the cumulative
+contents replace the oldest snapshot, and a window is the contents minus its oldest snapshot.
+***/
+void HistogramManager::publishWindows( HistBase * h, const std::vector<float>& values){
+  if (h->b_reset || h->b_norm) return; // contents are not cumulative
+
+  std::lock_guard<std::mutex> lock(h->m_hist_mutex); // windows may be added while publishing
+  for (auto& window : h->windows) {
+    if (window.next_slice == 0) window.next_slice = h->timestamp+window.slice;
+    for (unsigned ii = 0; h->timestamp >= window.next_slice; ii++) {
+      if (ii < window.snapshots.size()) { // after a longer gap the ring is simply refilled
+        window.snapshots[window.oldest] = values;
+        window.oldest = (window.oldest+1)%window.snapshots.size();
+      }
+      window.next_slice += window.slice;
+    }
+    std::vector<float> window_values(values);
+    const auto& oldest = window.snapshots[window.oldest];
+    if (oldest.size() == values.size())
+      for (unsigned bin = 0; bin < values.size(); bin++) window_values[bin] -= oldest[bin];
+
+    send(h, window.name, h->to_window(window, window_values, m_binary_format));
+    m_stats.full++;
+  }
+}
+
+void HistogramManager::addTimeWindow( HistBase * hist, unsigned int length, unsigned int slices){
+  if (hist->extendable || hist->b_reset || hist->b_norm || dynamic_cast<TrendHist*>(hist) || dynamic_cast<ProfileHist*>(hist)) {
+    WARNING("Time windows are only supported for cumulative histograms with fixed axes, not for "<<hist->name);
+    return;
+  }
+  unsigned int slice = std::max(1u, (length/std::max(1u, slices)+hist->delta_t-1)/hist->delta_t)*hist->delta_t;
+  HistBase::TimeWindow window;
+  window.length = length;
+  window.slice = slice;
+  window.snapshots.resize(std::max(1u, (length+slice/2)/slice));
+  window.name = hist->name+"_"+(length%60 ? std::to_string(length)+"s" : std::to_string(length/60)+"min");
+  INFO("Publishing "<<window.name<<" over the last "<<window.snapshots.size()*slice<<" s in steps of "<<slice<<" s");
+  std::lock_guard<std::mutex> lock(hist->m_hist_mutex);
+  hist->windows.push_back(window);
 }
 
 void HistogramManager::resetOnPublish(std::string name, bool reset){
@@ -122,6 +297,10 @@ void HistogramManager::normaliseOnPublish(std::string name, bool normalise){
   return;
 }
 
+void HistogramManager::noSamplingScale(std::string name, bool noScale){
+  if (auto hist = find(name)) hist->no_sampling_scale(noScale);
+}
+
 void HistogramManager::setNormalisationMetric(std::string name, std::atomic<int>* ptr){
   if ( m_histogram_map.count(name) ) {
     m_histogram_map[name]->normalise_on_publish();
@@ -133,12 +312,85 @@ void HistogramManager::setNormalisationMetric(std::string name, std::atomic<int>
   return;
 }
 
+void HistogramManager::setSamplingCounters(const std::atomic<uint64_t>* received, const std::atomic<uint64_t>* sampled){
+  m_events_received = received;
+  m_events_sampled = sampled;
+  for (auto &pair : m_histogram_map ) pair.second->set_sampling_counters(received, sampled);
+
+  return;
+}
+
 void HistogramManager::reset(std::string name){
-  if ( m_histogram_map.count(name) ) {
-    m_histogram_map[name]->reset();
-  }
-  else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+  if (auto hist = find(name)) reset(hist);
  
   return;
 }
+
+void HistogramManager::reset(HistBase * hist){
+  hist->reset(); // includes the shards
+  for (auto& window : hist->windows) {
+    window.snapshots.assign(window.snapshots.size(), {});
+    window.next_slice = 0;
+  }
+}
+
+HistBase * HistogramManager::find(const std::string& name){
+  auto hist = m_histogram_map.find(name);
+  if (hist == m_histogram_map.end()) {
+    WARNING("Histogram with name "<<name<<" does not exist.");
+    return nullptr;
+  }
+  return hist->second;
+}
+
+/***
+\brief: registering a name again returns the histogram already registered if it has the same kind
+and storage, and throws HistogramTypeMismatch otherwise, as its handle would fill the wrong type.
+***/
+HistBase * HistogramManager::addHistogram(HistBase * hist){
+  std::unique_lock<std::mutex> lock(m_stop_mutex);
+  auto inserted = m_histogram_map.insert( std::make_pair( hist->name, hist));
+  if (!inserted.second) {
+    HistBase * existing = inserted.first->second;
+    bool same_type = typeid(*existing) == typeid(*hist); // the handle returned casts to the requested type
+    delete hist;
+    if (!same_type) throw HistogramTypeMismatch(ERS_HERE, existing->name);
+    WARNING("Histogram with name "<<existing->name<<" already registered.");
+    return existing;
+  }
+  hist->set_sampling_counters(m_events_received, m_events_sampled);
+  for (unsigned i = 0; i < m_shards; i++) hist->shards.push_back(hist->make_shard());
+  m_unscheduled.push_back(hist);
+  lock.unlock();
+  m_stop_cv.notify_all();
+  return hist;
+}
+
+/***
+\brief: each thread filling histograms in parallel selects its own shard with setThreadShard().
+Shards are only filled by their thread and summed into the published histogram at publish time.
+***/
+void HistogramManager::setShards(unsigned nShards){
+  m_shards = nShards;
+  for (auto &pair : m_histogram_map ) {
+    HistBase * hist = pair.second;
+    hist->shards.clear();
+    for (unsigned i = 0; i < m_shards; i++) hist->shards.push_back(hist->make_shard());
+  }
+  INFO("Filling "<<m_histogram_map.size()<<" histograms through "<<m_shards<<" shards.");
+}
+
+void HistogramManager::report(){
+  static const char * storage_names[] = {"adaptive", "uint32", "sparse"};
+  size_t total_memory = 0, total_bytes = 0;
+  float total_us = 0;
+  for (auto &pair : m_histogram_map ) {
+    HistBase * h = pair.second;
+    INFO("Histogram "<<h->name<<": "<<storage_names[h->storage]<<" storage, "<<h->memory_bytes()<<" bytes, last publish "
+         <<h->publish_bytes<<" bytes in "<<h->publish_us<<" us");
+    total_memory += h->memory_bytes();
+    total_bytes += h->publish_bytes;
+    total_us += h->publish_us;
+  }
+  INFO(m_histogram_map.size()<<" histograms use "<<total_memory<<" bytes, publishing all takes "<<total_bytes<<" bytes and "<<total_us<<" us");
+}
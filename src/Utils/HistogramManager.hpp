@@ -6,8 +6,10 @@
 #include "zmq.hpp"
 #include <thread>
 #include <atomic>
+#include <condition_variable>
 #include <ctime>
 #include <iostream>
+#include <algorithm>
 #include <map>
 #include <type_traits> // is_integral, is_floating_point, ...
 
@@ -35,200 +37,284 @@ ERS_DECLARE_ISSUE_BASE(ERS_EMPTY,                                         // nam
       ERS_EMPTY,            // base class attributes
        ((std::string)zmq_ret )                                     // this class attributes
 )
+ERS_DECLARE_ISSUE_BASE(ERS_EMPTY,                                         // namespace name
+      HistogramTypeMismatch,                                                  // issue name
+      HistogramIssue,                                                // base issue name
+      " Histogram " << name << " is already registered with a different type or storage",                                 // message
+      ERS_EMPTY,            // base class attributes
+       ((std::string)name )                                     // this class attributes
+)
+
+/**
+ * Handle to a registered histogram, as returned by registerHistogram. Filling through a
+ * handle skips the lookup by name. Handles stay valid as long as their HistogramManager.
+ */
+template<typename Tag>
+struct HistHandle {
+  HistBase * hist = nullptr;
+  explicit operator bool() const { return hist != nullptr; }
+};
+using Hist1DHandle = HistHandle<struct Hist1DTag>;
+using Hist2DHandle = HistHandle<struct Hist2DTag>;
+using CategoryHistHandle = HistHandle<struct CategoryHistTag>;
+using TrendHandle = HistHandle<struct TrendTag>;
+using ProfileHandle = HistHandle<struct ProfileTag>;
 
 class HistogramManager{
 public:
 
  
   HistogramManager();
+  /// Publishes histograms under the given name instead of the module name
+  explicit HistogramManager(const std::string& name);
   
   ~HistogramManager();
 
   void configure(uint8_t ioT, std::string, unsigned interval = kMIN_INTERVAL*1000);
+  /// Also publishes histograms on connStr, e.g. to the histogram archiver (after configure)
+  void connect(std::string connStr);
+
+  /// Publishes histograms in the compact binary format (as <name>-hb_<hist>) instead of JSON
+  void setBinaryFormat(bool binary = true) { m_binary_format = binary; }
+
+  /**
+   * Publishes only what changed: unchanged histograms are skipped and sparse changes are sent
+   * as deltas, with a full publish at least every `keyframes` publish intervals. 0 (default)
+   * always publishes histograms in full.
+   */
+  void setKeyframeInterval(unsigned keyframes) { m_keyframe_interval = keyframes; }
+
+  /**
+   * zlib-compresses message bodies of at least `threshold` bytes, e.g. mostly empty hit maps,
+   * marked by a 'z' in the header ('-hz_', '-hbz_'). 0 (default) never compresses.
+   */
+  void setCompression(size_t threshold) { m_compression_threshold = threshold; }
+
+  struct PublishStats {
+    std::atomic<size_t> bytes{0};     // message bytes sent
+    std::atomic<size_t> time_us{0};   // time spent building and sending messages
+    std::atomic<int> full{0};         // histograms published in full
+    std::atomic<int> deltas{0};       // histograms published as deltas
+    std::atomic<int> skipped{0};      // unchanged histograms not published
+    std::atomic<size_t> memory{0};    // estimated bin storage of all histograms
+    std::atomic<int> compressed{0};   // messages sent compressed
+    std::atomic<size_t> compress_us{0}; // time spent compressing
+    std::atomic<float> compression_ratio{0}; // uncompressed over compressed bytes of all compressed messages
+  };
+  /// Publication counters, to be registered as module metrics
+  PublishStats& publishStats() { return m_stats; }
 
   void start();
 
   void stop();
   
-  void registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, Axis::Range extendable, unsigned int delta_t = kMIN_INTERVAL) {
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, Axis::Range extendable, unsigned int delta_t = kMIN_INTERVAL) {
+    return registerHistogram( name, xlabel, ylabel, xmin, xmax, xbins, extendable, Storage::ADAPTIVE, delta_t);
+  }
+
+  /// Fixed axis histogram with the given bin storage (extendable axes always use adaptive storage)
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, Storage::Type storage, unsigned int delta_t = kMIN_INTERVAL) {
+    return registerHistogram( name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, storage, delta_t);
+  }
+
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, Axis::Range extendable, Storage::Type storage, unsigned int delta_t) {
     INFO("Registering histogram "<<name);
 
     auto interval_in_s = m_interval/1000.;
 
     if ( delta_t < interval_in_s ){
-      delta_t = m_interval ;
+      delta_t = interval_in_s ;
       INFO("publishing interval cannnot be set below "<<interval_in_s<<" s. Setting publishing interval to "<<interval_in_s<<" s."); 
     }
   
     HistBase * hist;
     if (extendable)
       hist = new Hist<stretchy_hist_t>(name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::EXTENDABLE, delta_t);
-    else 
+    else if (storage == Storage::UINT32)
+      hist = new Hist<hist_u32_t>(name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t);
+    else {
+      if (storage != Storage::ADAPTIVE) WARNING("Sparse storage is only supported for 2D histograms, using adaptive storage for "<<name);
       hist = new Hist<hist_t>(name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t);
-    m_histogram_map.insert( std::make_pair( hist->name, hist));
+    }
 
-    return;
+    return {addHistogram(hist)};
   }
 
-  void registerHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, unsigned int delta_t = kMIN_INTERVAL ) {
-    registerHistogram( name, xlabel, "counts", xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t); 
-    return;
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, unsigned int delta_t = kMIN_INTERVAL ) {
+    return registerHistogram( name, xlabel, "counts", xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t); 
   }
 
-  void registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, unsigned int delta_t = kMIN_INTERVAL ) {
-    registerHistogram( name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t); 
-    return;
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, unsigned int delta_t = kMIN_INTERVAL ) {
+    return registerHistogram( name, xlabel, ylabel, xmin, xmax, xbins, Axis::Range::NONEXTENDABLE, delta_t); 
   }
 
-  void registerHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, Axis::Range extendable, unsigned int delta_t = kMIN_INTERVAL ) {
-    registerHistogram( name, xlabel, "counts", xmin, xmax, xbins, extendable, delta_t); 
-    return;
+  Hist1DHandle registerHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, Axis::Range extendable, unsigned int delta_t = kMIN_INTERVAL ) {
+    return registerHistogram( name, xlabel, "counts", xmin, xmax, xbins, extendable, delta_t); 
   }
 
-  void registerHistogram( std::string name, std::string xlabel, std::string ylabel, std::vector<std::string> categories, unsigned int delta_t = kMIN_INTERVAL ){
+  CategoryHistHandle registerHistogram( std::string name, std::string xlabel, std::string ylabel, std::vector<std::string> categories, unsigned int delta_t = kMIN_INTERVAL ){
     INFO("Registering histogram "<<name);
 
     auto interval_in_s = m_interval/1000.;
     if ( delta_t < interval_in_s ){
-      delta_t = m_interval ;
+      delta_t = interval_in_s ;
       INFO("publishing interval cannnot be set below "<<interval_in_s<<" s. Setting publishing interval to "<<interval_in_s<<" s."); 
     }
 
     HistBase * hist = new CategoryHist(name, xlabel, ylabel, categories, delta_t);
-    m_histogram_map.insert( std::make_pair( hist->name, hist));
   
-    return;
+    return {addHistogram(hist)};
+  }
+
+  CategoryHistHandle registerHistogram( std::string name, std::string xlabel, std::vector<std::string> categories, unsigned int delta_t = kMIN_INTERVAL ){
+    return registerHistogram( name, xlabel, "counts", categories, delta_t);
   }
 
-  void registerHistogram( std::string name, std::string xlabel, std::vector<std::string> categories, unsigned int delta_t = kMIN_INTERVAL ){
-    registerHistogram( name, xlabel, "counts", categories, delta_t);
-    return;
+  Hist2DHandle register2DHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, std::string ylabel, float ymin, float ymax, unsigned int ybins, unsigned int delta_t = kMIN_INTERVAL ) {
+    return register2DHistogram( name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, Storage::ADAPTIVE, delta_t);
   }
 
-  void register2DHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, std::string ylabel, float ymin, float ymax, unsigned int ybins, unsigned int delta_t = kMIN_INTERVAL ) {
+  Hist2DHandle register2DHistogram( std::string name, std::string xlabel, float xmin, float xmax, unsigned int xbins, std::string ylabel, float ymin, float ymax, unsigned int ybins, Storage::Type storage, unsigned int delta_t = kMIN_INTERVAL ) {
     INFO("Registering histogram "<<name);
     
     auto interval_in_s = m_interval/1000.;
 
     if ( delta_t < interval_in_s ){
-      delta_t = m_interval ;
+      delta_t = interval_in_s ;
+      INFO("publishing interval cannnot be set below "<<interval_in_s<<" s. Setting publishing interval to "<<interval_in_s<<" s."); 
+    }
+    HistBase * hist2D;
+    if (storage == Storage::UINT32)
+      hist2D = new Hist2D<hist2d_u32_t>(name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, delta_t);
+    else if (storage == Storage::SPARSE)
+      hist2D = new Hist2D<hist2d_sparse_t>(name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, delta_t);
+    else
+      hist2D = new Hist2D<hist2d_t>(name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, delta_t);
+
+    return {addHistogram(hist2D)};
+  }
+
+  /**
+   * Trend of a scalar such as a pedestal mean: the mean of the values filled in each `interval`
+   * seconds (rounded up to a multiple of delta_t), over the last `points` intervals.
+   */
+  TrendHandle registerTrend( std::string name, std::string ylabel, unsigned int points, unsigned int interval, unsigned int delta_t = kMIN_INTERVAL ) {
+    INFO("Registering trend "<<name);
+
+    auto interval_in_s = m_interval/1000.;
+    if ( delta_t < interval_in_s ){
+      delta_t = interval_in_s ;
+      INFO("publishing interval cannnot be set below "<<interval_in_s<<" s. Setting publishing interval to "<<interval_in_s<<" s."); 
+    }
+    interval = std::max(1u, (interval+delta_t-1)/delta_t)*delta_t;
+
+    HistBase * trend = new TrendHist(name, ylabel, std::max(1u, points), interval, delta_t);
+
+    return {addHistogram(trend)};
+  }
+
+  /// Mean (and spread) of the values filled per bin of x, e.g. the mean pedestal per channel
+  ProfileHandle registerProfile( std::string name, std::string xlabel, std::string ylabel, float xmin, float xmax, unsigned int xbins, unsigned int delta_t = kMIN_INTERVAL ) {
+    INFO("Registering profile "<<name);
+
+    auto interval_in_s = m_interval/1000.;
+    if ( delta_t < interval_in_s ){
+      delta_t = interval_in_s ;
       INFO("publishing interval cannnot be set below "<<interval_in_s<<" s. Setting publishing interval to "<<interval_in_s<<" s."); 
     }
-    HistBase * hist2D = new Hist2D(name, xlabel, xmin, xmax, xbins, ylabel, ymin, ymax, ybins, delta_t);
-    m_histogram_map.insert( std::make_pair( hist2D->name, hist2D));
 
-    return;
+    HistBase * profile = new ProfileHist(name, xlabel, ylabel, xmin, xmax, xbins, delta_t);
+
+    return {addHistogram(profile)};
   }
 
+  /**
+   * Also publishes the contents of the last `window` seconds only, as <name>_<window>s (or
+   * _<minutes>min). The window moves in `slices` steps of at least the publish interval,
+   * computed from snapshots of the contents without refilling. Not for extendable histograms,
+   * trends, profiles, or histograms reset or normalised on publish.
+   */
+  template<typename Tag> void addTimeWindow( HistHandle<Tag> h, unsigned int window, unsigned int slices = 10 ) { addTimeWindow(h.hist, window, slices); }
+
   void publish( HistBase * h);
 
+  // fill by handle: no lookup or allocation
+
   template<typename X, typename W = int>
-  void fill( std::string name, X value, W weight=1 ){
+  void fill( Hist1DHandle h, X value, W weight=1 ){
     
     static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
                   "Cannot fill histogram with invalid value type. Value must be numeric.");
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
 
-    if ( m_histogram_map.count(name) ) {
-      HistBase * hist = m_histogram_map[name];
-      if (hist->extendable)
-        static_cast<Hist<stretchy_hist_t>*>(hist)->fill(value, weight);
-      else 
-        static_cast<Hist<hist_t>*>(hist)->fill(value, weight);
-    }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+    visit1D(h.hist->fill_target(m_thread_shard), [&](auto hist) { hist->fill(value, weight); });
   }
 
+  // bulk fills: all entries in one go, bins computed in blocks for fixed axes
+
   template<typename X, typename W>
-  void fill( std::string name, std::vector<X> values, std::vector<W> weights )  {
+  void fill( Hist1DHandle h, ValueSpan<X> values, ValueSpan<W> weights )  {
 
     static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
                   "Cannot fill histogram with invalid value type. Value must be numeric.");
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
 
-    unsigned indices = values.size();
-    if ( indices != weights.size()) {
+    if ( values.size != weights.size) {
       WARNING("Can't fill histogram. Given position and weight vectors not of same size.");
       return;
     }
 
-    if ( m_histogram_map.count(name) ) {
-      HistBase * base = m_histogram_map[name];
-      if (base->extendable) {
-        Hist<stretchy_hist_t>* hist = static_cast<Hist<stretchy_hist_t>*>(base); 
-        for ( unsigned i = 0; i < indices; i++ ){
-          hist->fill(values.at(i), weights.at(i)); // TODO does boost histogram support filling of arrays? weights function might be a problem.
-        }
-      } else {
-        Hist<hist_t>* hist = static_cast<Hist<hist_t>*>(base); 
-        for ( unsigned i = 0; i < indices; i++ ){
-          hist->fill(values.at(i), weights.at(i));
-        }
-      }
-    }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+    visit1D(h.hist->fill_target(m_thread_shard), [&](auto hist) { hist->fill_n(values.data, weights.data, values.size); });
   }
 
   template<typename X, typename W>
-  void fill( std::string name, X start_value, X step, std::vector<W> weights )  {
+  void fill( Hist1DHandle h, X start_value, X step, ValueSpan<W> weights )  {
 
     static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
                   "Cannot fill histogram with invalid value type. Value must be numeric.");
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
 
-    if ( m_histogram_map.count(name) ) {
-      HistBase * base = m_histogram_map[name];
-      if (base->extendable) {
-        Hist<stretchy_hist_t>* hist = static_cast<Hist<stretchy_hist_t>*>(base); 
-        for ( unsigned i = 0; i < weights.size(); i++ ){
-          X value = start_value+i*step;
-          hist->fill(value, weights.at(i)); // TODO does boost histogram support filling of arrays? weights function might be a problem
-        }
-      } else {
-        Hist<hist_t>* hist = static_cast<Hist<hist_t>*>(base); 
-        for ( unsigned i = 0; i < weights.size(); i++ ){
-          X value = start_value+i*step;
-          hist->fill(value, weights.at(i));
-        }
-      }
-    }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+    visit1D(h.hist->fill_target(m_thread_shard), [&](auto hist) { hist->fill_n(start_value, step, weights.data, weights.size); });
+  }
+
+  template<typename X, typename W>
+  void fill( Hist1DHandle h, const std::vector<X>& values, const std::vector<W>& weights )  {
+    fill(h, ValueSpan<X>(values), ValueSpan<W>(weights));
+  }
+
+  template<typename X, typename W>
+  void fill( Hist1DHandle h, X start_value, X step, const std::vector<W>& weights )  {
+    fill(h, start_value, step, ValueSpan<W>(weights));
   }
 
   template<typename W = int>
-  void fill( std::string name, std::string value, W weight=1 )  {
+  void fill( CategoryHistHandle h, const std::string& value, W weight=1 )  {
 
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
     
-    if ( m_histogram_map.count(name) ) {
-      static_cast<CategoryHist*>(m_histogram_map[name])->fill(value, weight);
-    }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+    static_cast<CategoryHist*>(h.hist->fill_target(m_thread_shard))->fill(value, weight);
+  }
+
+  /// Bin of a category, to fill repeatedly with fillBin() without comparing strings
+  int categoryBin( CategoryHistHandle h, const std::string& value ) const {
+    return static_cast<CategoryHist*>(h.hist)->bin(value);
   }
 
   template<typename W = int>
-  void fill( std::string name, const char * value, W weight=1 )  {
+  void fillBin( CategoryHistHandle h, int bin, W weight=1 )  {
 
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
-    
-    if ( m_histogram_map.count(name) ) {
-      static_cast<CategoryHist*>(m_histogram_map[name])->fill(value, weight);
-    }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+
+    static_cast<CategoryHist*>(h.hist->fill_target(m_thread_shard))->fill_bin(bin, weight);
   }
 
   template<typename X, typename Y, typename W = int>
-  void fill2D( std::string name, X xvalue, Y yvalue, W weight=1 ){
+  void fill2D( Hist2DHandle h, X xvalue, Y yvalue, W weight=1 ){
     
     static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
                   "Cannot fill histogram with invalid x value type. Value must be numeric.");
@@ -237,27 +323,131 @@ public:
     static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
                   "Cannot fill histogram with invalid weight value type. Value must be numeric.");
 
-    if ( m_histogram_map.count(name) ) {
-     static_cast<Hist2D*>(m_histogram_map[name])->fill(xvalue, yvalue, weight);
+    HistBase * hist = h.hist->fill_target(m_thread_shard);
+    switch (hist->storage) {
+      case Storage::UINT32: static_cast<Hist2D<hist2d_u32_t>*>(hist)->fill(xvalue, yvalue, weight); break;
+      case Storage::SPARSE: static_cast<Hist2D<hist2d_sparse_t>*>(hist)->fill(xvalue, yvalue, weight); break;
+      default: static_cast<Hist2D<hist2d_t>*>(hist)->fill(xvalue, yvalue, weight);
     }
-    else 
-      WARNING("Histogram with name "<<name<<" does not exist.");
+  }
+
+  template<typename X, typename W = int>
+  void fill( TrendHandle h, X value, W weight=1 ){
+
+    static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
+                  "Cannot fill trend with invalid value type. Value must be numeric.");
+    static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
+                  "Cannot fill trend with invalid weight value type. Value must be numeric.");
+
+    static_cast<TrendHist*>(h.hist->fill_target(m_thread_shard))->fill(value, weight);
+  }
+
+  template<typename X, typename Y, typename W = int>
+  void fill( ProfileHandle h, X xvalue, Y yvalue, W weight=1 ){
+
+    static_assert(std::is_integral<X>::value || std::is_floating_point<X>::value,
+                  "Cannot fill profile with invalid x value type. Value must be numeric.");
+    static_assert(std::is_integral<Y>::value || std::is_floating_point<Y>::value,
+                  "Cannot fill profile with invalid y value type. Value must be numeric.");
+    static_assert(std::is_integral<W>::value || std::is_floating_point<W>::value,
+                  "Cannot fill profile with invalid weight value type. Value must be numeric.");
+
+    static_cast<ProfileHist*>(h.hist->fill_target(m_thread_shard))->fill(xvalue, yvalue, weight);
+  }
+
+  // fill by name: one lookup per call, use handles in hot loops (trends and profiles are filled by handle only)
+
+  template<typename X, typename W = int>
+  void fill( const std::string& name, X value, W weight=1 ){
+    if (auto hist = find(name)) fill(Hist1DHandle{hist}, value, weight);
+  }
+
+  template<typename X, typename W>
+  void fill( const std::string& name, const std::vector<X>& values, const std::vector<W>& weights )  {
+    if (auto hist = find(name)) fill(Hist1DHandle{hist}, values, weights);
+  }
+
+  template<typename X, typename W>
+  void fill( const std::string& name, X start_value, X step, const std::vector<W>& weights )  {
+    if (auto hist = find(name)) fill(Hist1DHandle{hist}, start_value, step, weights);
+  }
+
+  template<typename W = int>
+  void fill( const std::string& name, const std::string& value, W weight=1 )  {
+    if (auto hist = find(name)) fill(CategoryHistHandle{hist}, value, weight);
+  }
+
+  template<typename W = int>
+  void fill( const std::string& name, const char * value, W weight=1 )  {
+    if (auto hist = find(name)) fill(CategoryHistHandle{hist}, value, weight);
+  }
+
+  template<typename X, typename Y, typename W = int>
+  void fill2D( const std::string& name, X xvalue, Y yvalue, W weight=1 ){
+    if (auto hist = find(name)) fill2D(Hist2DHandle{hist}, xvalue, yvalue, weight);
   }
 
   void resetOnPublish(std::string, bool reset = true);
   void normaliseOnPublish(std::string, bool normalise = true);
   void setNormalisationMetric(std::string, std::atomic<int> *);
+  /**
+   * Scales histograms that are not normalised by the events received over those monitored
+   * since their last reset, given by two counters that only grow.
+   */
+  void setSamplingCounters(const std::atomic<uint64_t> * received, const std::atomic<uint64_t> * sampled);
+  /// Never scales a histogram for sampling, e.g. one showing the last event only
+  void noSamplingScale(std::string, bool noScale = true);
+  template<typename Tag> void noSamplingScale(HistHandle<Tag> h, bool noScale = true) { h.hist->no_sampling_scale(noScale); }
 
   void reset(std::string);
+  template<typename Tag> void reset(HistHandle<Tag> h) { reset(h.hist); }
+
+  /// Creates nShards per-thread copies of each histogram, summed into the histogram when it is published
+  void setShards(unsigned nShards);
+  /// Selects the shard filled by the calling thread, -1 (default) to fill the histograms directly
+  static void setThreadShard(int shard) { m_thread_shard = shard; }
+
+  /// Logs storage type, memory and last publish cost of every histogram
+  void report();
 
   private:
 
+  /// Calls f with the histogram cast to its concrete 1D type
+  template<typename F>
+  static void visit1D( HistBase * hist, F&& f ) {
+    if (hist->extendable) f(static_cast<Hist<stretchy_hist_t>*>(hist));
+    else if (hist->storage == Storage::UINT32) f(static_cast<Hist<hist_u32_t>*>(hist));
+    else f(static_cast<Hist<hist_t>*>(hist));
+  }
+
+  static thread_local int m_thread_shard;
+  unsigned m_shards = 0;
+  const std::atomic<uint64_t>* m_events_received = nullptr;
+  const std::atomic<uint64_t>* m_events_sampled = nullptr;
+  HistBase * addHistogram(HistBase * hist);
+  HistBase * find(const std::string& name);
+  void publish(HistBase * h, bool full);
+  void publishWindows(HistBase * h, const std::vector<float>& values);
+  size_t send(HistBase * h, const std::string& name, const std::string& body);
+  void addTimeWindow(HistBase * hist, unsigned int window, unsigned int slices);
+  void reset(HistBase * hist);
+
   // Thread control
   std::thread m_histogram_thread;
   std::atomic<bool> m_stop_thread;
+  std::mutex m_stop_mutex;            // also guards m_histogram_map insertions and m_unscheduled
+  std::condition_variable m_stop_cv; // wakes the publisher thread early to stop or schedule new histograms
+  std::vector<HistBase *> m_unscheduled; // registered since the publisher thread last looked
 
   // Config for data publishing
   std::atomic<bool> m_zmq_publisher;
+  bool m_binary_format = false;
+  unsigned m_keyframe_interval = 0;
+  size_t m_compression_threshold = 0;
+  std::string m_compressed;             // compression buffer, reused by the publishing thread
+  size_t m_raw_bytes = 0, m_compressed_bytes = 0;
+  std::atomic<uint64_t> m_publish_ns{0}, m_compress_ns{0}; // exact totals behind the whole us in m_stats
+  PublishStats m_stats;
 
   // Publish socket ref for hists
   std::unique_ptr<zmq::socket_t> m_histo_socket;
@@ -0,0 +1,96 @@
+/*
+  Copyright (C) 2019-2020 CERN for the benefit of the FASER collaboration
+*/
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "Utils/Histogram.hpp"
+
+/**
+ * Histogram publication as received on a stats connection: '<source>-h_<name>: <json>' or
+ * '<source>-hb_<name>: <binary>' (see HistogramManager::publish), with a 'z' before the '_'
+ * ('-hz_', '-hbz_') if the body is zlib-compressed. Anything else is a metric.
+ */
+struct HistogramMessage {
+  std::string source;
+  bool binary = false;
+  bool compressed = false;
+  const char* body = nullptr; // points into the received message
+  size_t size = 0;
+
+  /// Splits a stats message, returns false if it is not a histogram. The source is set in any case.
+  bool split(const char* data, size_t length) {
+    std::string head(data, std::min<size_t>(length, 256));
+    size_t end = head.find(": ");
+    size_t dash = head.find('-');
+    source = head.substr(0, dash);
+    if (dash>=end || end==std::string::npos) return false;
+    size_t pos = dash+1;
+    if (head.compare(pos++, 1, "h")!=0) return false;
+    binary = head.compare(pos, 1, "b")==0;
+    if (binary) pos++;
+    compressed = head.compare(pos, 1, "z")==0;
+    if (compressed) pos++;
+    if (head.compare(pos, 1, "_")!=0) return false;
+    body = data+end+2;
+    size = length-end-2;
+    return true;
+  }
+
+  /// Decodes the histogram into schema (the JSON message without bin contents) and values
+  bool decode(json& schema, std::vector<float>& values) const {
+    if (compressed) {
+      std::string inflated;
+      if (!decompress_body(body, size, inflated)) return false;
+      HistogramMessage plain(*this);
+      plain.compressed = false;
+      plain.body = inflated.data();
+      plain.size = inflated.size();
+      return plain.decode(schema, values);
+    }
+    if (binary) return HistBase::decode_binary(body, size, schema, values);
+    schema = json::parse(body, body+size, nullptr, false);
+    if (schema.is_discarded() || !schema.is_object()) return false;
+    const char* key = schema.contains("zvalues") ? "zvalues" : "yvalues";
+    if (schema.contains(key)) {
+      values = schema[key].get<std::vector<float>>();
+      schema.erase(key);
+    }
+    else values.clear();
+    return true;
+  }
+
+  /// zlib-compresses a message body into out, returns false on failure
+  static bool compress_body(const std::string& body, std::string& out, int level = Z_BEST_SPEED) {
+    uLongf size = compressBound(body.size());
+    out.resize(size);
+    if (compress2(reinterpret_cast<Bytef*>(&out[0]), &size, reinterpret_cast<const Bytef*>(body.data()), body.size(), level)!=Z_OK)
+      return false;
+    out.resize(size);
+    return true;
+  }
+
+  /// Inverse of compress_body, returns false if the data is not a complete zlib stream
+  static bool decompress_body(const char* data, size_t length, std::string& out) {
+    z_stream stream{};
+    if (inflateInit(&stream)!=Z_OK) return false;
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = length;
+    out.resize(std::max<size_t>(4*length, 1024)); // histograms of mostly zeros compress well
+    int rc = Z_OK;
+    while (rc==Z_OK) {
+      if (stream.total_out==out.size()) out.resize(2*out.size());
+      stream.next_out = reinterpret_cast<Bytef*>(&out[stream.total_out]);
+      stream.avail_out = out.size()-stream.total_out;
+      rc = inflate(&stream, Z_NO_FLUSH);
+    }
+    out.resize(stream.total_out);
+    inflateEnd(&stream);
+    return rc==Z_STREAM_END;
+  }
+};